@@ -0,0 +1,350 @@
+#include "../src/editor.hpp"
+#include "../src/file.hpp"
+#include "../src/gap_buffer.hpp"
+#include "../src/terminal.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+
+/**
+
+   alter_bench [max MiB]
+
+   Timings of the paths an edit session spends its time in:
+   gap buffer edits and cursor moves, opening (and indexing)
+   synthetic 1 MiB / 100 MiB / 1 GiB files, drawing frames
+   (ASCII, wrapped, UTF-8) into the append buffer with
+   nothing sent to a terminal, and save_as. Files bigger
+   than max MiB (default 1024) are skipped.
+
+   Progress goes to stderr, the results to stdout as JSON:
+
+     {"benchmarks": [
+       {"name": "gap_buffer/insert_middle", "ops": 1000000,
+        "ns_per_op": 2.1, "bytes_per_sec": 4.7e8}, ...
+     ]}
+
+   Every timing is the best of a few runs.
+
+ */
+
+
+typedef struct result {
+  std::string name;
+  size_t ops;
+  double seconds;
+  double bytes;
+} result_t;
+
+std::vector<result_t> results;
+
+
+template<typename F>
+double best_of(int runs, F f) {
+  double best = 1e30;
+  for(int i = 0; i < runs; i++) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+  }
+  return best;
+}
+
+
+void report(std::string name, size_t ops, double bytes, double seconds) {
+  results.push_back({name, ops, seconds, bytes});
+  fprintf(stderr, "%-32s %10.1f ns/op %10.1f MB/s\n", name.c_str(),
+          seconds / ops * 1e9, bytes / seconds / 1e6);
+}
+
+
+// random length lines of printable text, like source code.
+void write_file(const std::string& path, size_t size) {
+
+  std::ofstream out(path, std::ios::binary);
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> line_len(0, 120);
+
+  std::string chunk;
+  size_t written = 0;
+
+  while(written < size) {
+    chunk.clear();
+    while(chunk.size() < (1 << 20) && written + chunk.size() < size) {
+      int n = line_len(rng);
+      for(int i = 0; i < n; i++)
+        chunk.push_back('a' + (i % 26));
+      chunk.push_back('\n');
+    }
+    out.write(chunk.data(), chunk.size());
+    written += chunk.size();
+  }
+
+}
+
+
+// bytes of text on the lines the last display() drew.
+uint64_t shown(files::Editor_File& f, editor::Frame& frame) {
+  return f.line_tree.offset_of_line(frame.end_line_number + 1)
+    - f.line_tree.offset_of_line(frame.start_line_number);
+}
+
+
+void bench_gap_buffer() {
+
+  using Buffer = buffers::Gap_Buffer<GAP_BUFFER_SIZE>;
+
+  const size_t text = 64 << 10;
+  const size_t n = 1 << 20;
+  const std::string filler(text, 'x');
+
+  struct { const char* name; size_t at; } places[] = {
+    {"start", 0}, {"middle", text / 2}, {"end", text},
+  };
+
+  for(auto p : places) {
+    double t = best_of(3, [&]() {
+      Buffer b;
+      b.load(filler.data(), filler.size());
+      b.move_gap_to(p.at);
+      for(size_t i = 0; i < n; i++)
+        b.insert('a' + (i & 15));
+    });
+    report(std::string("gap_buffer/insert_") + p.name, n, n, t);
+  }
+
+  for(auto p : places) {
+    // backspace needs text before the cursor, delete after it.
+    const bool back = p.at == text;
+    double t = best_of(3, [&]() {
+      Buffer b;
+      b.load(filler.data(), filler.size());
+      b.move_gap_to(p.at);
+      for(size_t i = 0; i < text / 2; i++) {
+        if(back)
+          b.free();
+        else
+          b.erase(1);
+      }
+    });
+    report(std::string("gap_buffer/delete_") + p.name, text / 2, text / 2, t);
+  }
+
+  {
+    // one step at a time, as arrow keys do.
+    double t = best_of(3, [&]() {
+      Buffer b;
+      b.load(filler.data(), filler.size());
+      for(size_t i = 0; i < n; i++) {
+        if((i / text) & 1)
+          b.decrement_cursor();
+        else
+          b.increment_cursor();
+      }
+    });
+    report("gap_buffer/step_cursor", n, n, t);
+  }
+
+  {
+    // jumps anywhere in the line, as search and clicks do.
+    std::mt19937 rng(7);
+    std::vector<size_t> to(4096);
+    for(auto& x : to)
+      x = rng() % (text + 1);
+
+    size_t moved = 0;
+    double t = best_of(3, [&]() {
+      Buffer b;
+      b.load(filler.data(), filler.size());
+      size_t at = 0;
+      moved = 0;
+      for(auto x : to) {
+        moved += x > at ? x - at : at - x;
+        b.move_gap_to(x);
+        at = x;
+      }
+    });
+    report("gap_buffer/move_gap", to.size(), moved, t);
+  }
+
+}
+
+
+void bench_file(const std::string& path, size_t size, const std::string& tag) {
+
+  {
+    // what the user waits for: the first screen.
+    double t = best_of(3, [&]() {
+      files::Editor_File f(path);
+    });
+    report("file/open_" + tag, 1, size, t);
+  }
+
+  {
+    double t = best_of(3, [&]() {
+      files::Editor_File f(path);
+      while(!f.poll_index(true)) {}
+    });
+    report("file/open_indexed_" + tag, 1, size, t);
+  }
+
+  files::Editor_File f(path);
+  while(!f.poll_index(true)) {}
+
+  {
+    // drawing the same screen, then screens all over the file.
+    editor::Frame frame(&f, 28, 0);
+    const int frames = 2000;
+
+    double t = best_of(3, [&]() {
+      for(int i = 0; i < frames; i++) {
+        frame.display();
+        terminal::clear_append();
+      }
+    });
+    report("render/frame_" + tag, frames, frames * (double) shown(f, frame), t);
+
+    std::mt19937 rng(9);
+    std::vector<int> starts(frames);
+    for(auto& s : starts)
+      s = rng() % (f.lines > 28 ? f.lines - 28 : 1);
+
+    uint64_t bytes = 0;
+    t = best_of(3, [&]() {
+      bytes = 0;
+      for(auto s : starts) {
+        frame.start_line_number = s;
+        frame.display();
+        terminal::clear_append();
+        bytes += shown(f, frame);
+      }
+    });
+    report("render/frame_jump_" + tag, frames, bytes, t);
+  }
+
+  const std::string out = path + ".saved";
+
+  {
+    // untouched, every byte can come straight from the source.
+    double t = best_of(3, [&]() {
+      f.save_as(out.c_str());
+    });
+    report("save/save_as_clean_" + tag, 1, f.line_tree.bytes(), t);
+  }
+
+  {
+    // an edit every 64 lines, the rest still clean.
+    for(size_t n = 0; n < f.lines; n += 64) {
+      f.goto_line(n);
+      f.write_char('#');
+    }
+
+    double t = best_of(3, [&]() {
+      f.save_as(out.c_str());
+    });
+    report("save/save_as_edited_" + tag, 1, f.line_tree.bytes(), t);
+  }
+
+  unlink(out.c_str());
+
+}
+
+
+void bench_render_wrapped(const std::string& dir) {
+
+  // long lines wrap onto several rows each.
+  const std::string path = dir + "/alter_bench_wrap.txt";
+  {
+    std::ofstream out(path, std::ios::binary);
+    for(int i = 0; i < 200; i++)
+      out << std::string(1000, 'a' + i % 26) << '\n';
+  }
+
+  files::Editor_File f(path);
+  editor::Frame frame(&f, 28, 0);
+  const int frames = 2000;
+
+  double t = best_of(3, [&]() {
+    for(int i = 0; i < frames; i++) {
+      frame.display();
+      terminal::clear_append();
+    }
+  });
+  report("render/frame_wrapped", frames, frames * (double) shown(f, frame), t);
+
+  unlink(path.c_str());
+
+}
+
+
+// the same, with wide and combining characters to lay out.
+void bench_render_utf8(const std::string& dir) {
+
+  const std::string path = dir + "/alter_bench_utf8.txt";
+  {
+    std::ofstream out(path, std::ios::binary);
+    for(int i = 0; i < 200; i++) {
+      for(int k = 0; k < 100; k++)
+        out << (k % 3 == 0 ? "漢字" : k % 3 == 1 ? "e\xcc\x81t\xc3\xa9" : "text");
+      out << '\n';
+    }
+  }
+
+  files::Editor_File f(path);
+  editor::Frame frame(&f, 28, 0);
+  const int frames = 2000;
+
+  double t = best_of(3, [&]() {
+    for(int i = 0; i < frames; i++) {
+      frame.display();
+      terminal::clear_append();
+    }
+  });
+  report("render/frame_utf8", frames, frames * (double) shown(f, frame), t);
+
+  unlink(path.c_str());
+
+}
+
+
+int main(int argc, char** argv) {
+
+  const size_t max_mib = argc > 1 ? std::stoul(argv[1]) : 1024;
+
+  const std::string dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+  bench_gap_buffer();
+  bench_render_wrapped(dir);
+  bench_render_utf8(dir);
+
+  for(size_t mib : {1, 100, 1024}) {
+    if(mib > max_mib)
+      continue;
+
+    const std::string tag = mib < 1024 ? std::to_string(mib) + "MiB" : std::to_string(mib / 1024) + "GiB";
+    const std::string path = dir + "/alter_bench_" + tag + ".txt";
+
+    fprintf(stderr, "writing %s\n", path.c_str());
+    write_file(path, mib << 20);
+    bench_file(path, mib << 20, tag);
+    unlink(path.c_str());
+  }
+
+  printf("{\"benchmarks\": [\n");
+  for(size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    printf("  {\"name\": \"%s\", \"ops\": %zu, \"ns_per_op\": %.3f, \"bytes_per_sec\": %.1f}%s\n",
+           r.name.c_str(), r.ops, r.seconds / r.ops * 1e9, r.bytes / r.seconds,
+           i + 1 < results.size() ? "," : "");
+  }
+  printf("]}\n");
+
+}
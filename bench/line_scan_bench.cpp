@@ -0,0 +1,89 @@
+#include "../src/line_index.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+/**
+
+   line_scan_bench [MiB]
+
+   Throughput of the newline scanners used to index a file
+   on open, against the std::getline loop Editor_File used
+   before. Runs on a synthetic buffer of random length lines.
+
+ */
+
+
+template<typename F>
+double best_of(int runs, F f) {
+  double best = 1e30;
+  for(int i = 0; i < runs; i++) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+  }
+  return best;
+}
+
+
+int main(int argc, char** argv) {
+
+  const size_t mib = argc > 1 ? std::stoul(argv[1]) : 256;
+  const size_t size = mib << 20;
+
+  std::string text;
+  text.reserve(size);
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> line_len(0, 120);
+
+  while(text.size() < size) {
+    int n = line_len(rng);
+    for(int i = 0; i < n && text.size() < size; i++)
+      text.push_back('a' + (i % 26));
+    text.push_back('\n');
+  }
+
+  std::vector<uint64_t> starts;
+  size_t expected = 0;
+
+  {
+    std::istringstream in(text);
+    double t = best_of(3, [&]() {
+      in.clear();
+      in.seekg(0);
+      size_t lines = 0;
+      for(std::string s; std::getline(in, s); )
+        lines++;
+      expected = lines;
+    });
+    printf("%-8s %8.2f GB/s  %zu lines\n", "getline", text.size() / t / 1e9, expected);
+  }
+
+
+  for(auto k : {files::Scan_Kernel::scalar, files::Scan_Kernel::sse2, files::Scan_Kernel::avx2}) {
+
+    if(!files::scan_kernel_supported(k)) {
+      printf("%-8s unsupported\n", files::scan_kernel_name(k));
+      continue;
+    }
+
+    double t = best_of(5, [&]() {
+      starts.clear();
+      files::find_newlines(k, text.data(), text.size(), 0, starts);
+    });
+
+    printf("%-8s %8.2f GB/s  %zu lines%s\n", files::scan_kernel_name(k),
+           text.size() / t / 1e9, starts.size(),
+           starts.size() == expected ? "" : "  MISMATCH");
+  }
+
+  printf("selected: %s\n", files::scan_kernel_name(files::best_scan_kernel()));
+
+}
@@ -0,0 +1,124 @@
+#include "arena.hpp"
+
+#include <cstdlib>
+
+namespace buffers {
+
+
+  Byte_Pool::~Byte_Pool() {
+
+    for(auto c : this->chunks) {
+      delete[] c;
+    }
+
+    for(auto b = this->big; b != nullptr; ) {
+      auto togo = b->next;
+      std::free(b);
+      b = togo;
+    }
+
+  }
+
+
+  size_t Byte_Pool::round_up(size_t n) {
+
+    if(n > MAX_CLASS) {
+      return (n + 4095) & ~size_t(4095);
+    }
+
+    size_t c = MIN_CLASS;
+    while(c < n) {
+      c <<= 1;
+    }
+    return c;
+
+  }
+
+
+  int Byte_Pool::class_of(size_t capacity) {
+    return __builtin_ctzll(capacity) - __builtin_ctzll(MIN_CLASS);
+  }
+
+
+  void Byte_Pool::push_free(char* p, size_t capacity) {
+    auto f = reinterpret_cast<Free*>(p);
+    auto& head = this->free_lists[class_of(capacity)];
+    f->next = head;
+    head = f;
+  }
+
+
+  char* Byte_Pool::allocate(size_t n) {
+
+    const size_t capacity = round_up(n);
+
+    if(capacity > MAX_CLASS) [[unlikely]] {
+      auto b = static_cast<Big*>(std::malloc(sizeof(Big) + capacity));
+      if(b == nullptr)
+        throw std::bad_alloc();
+
+      b->prev = nullptr;
+      b->next = this->big;
+      if(this->big)
+        this->big->prev = b;
+      this->big = b;
+
+      return reinterpret_cast<char*>(b + 1);
+    }
+
+
+    auto& head = this->free_lists[class_of(capacity)];
+
+    if(head != nullptr) {
+      auto p = reinterpret_cast<char*>(head);
+      head = head->next;
+      return p;
+    }
+
+
+    if(size_t(this->chunk_end - this->chunk_pos) < capacity) {
+
+      // hand what is left of the old chunk out to the free lists.
+      for(size_t c = MAX_CLASS; c >= MIN_CLASS; c >>= 1) {
+        while(size_t(this->chunk_end - this->chunk_pos) >= c) {
+          this->push_free(this->chunk_pos, c);
+          this->chunk_pos += c;
+        }
+      }
+
+      this->chunks.push_back(new char[CHUNK]);
+      this->chunk_pos = this->chunks.back();
+      this->chunk_end = this->chunk_pos + CHUNK;
+    }
+
+    auto p = this->chunk_pos;
+    this->chunk_pos += capacity;
+    return p;
+
+  }
+
+
+  void Byte_Pool::release(char* p, size_t n) {
+
+    const size_t capacity = round_up(n);
+
+    if(capacity > MAX_CLASS) [[unlikely]] {
+      auto b = reinterpret_cast<Big*>(p) - 1;
+
+      if(b->prev)
+        b->prev->next = b->next;
+      else
+        this->big = b->next;
+
+      if(b->next)
+        b->next->prev = b->prev;
+
+      std::free(b);
+      return;
+    }
+
+    this->push_free(p, capacity);
+
+  }
+
+}
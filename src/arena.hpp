@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace buffers {
+
+
+  /**
+
+     Slab
+
+     Fixed size objects carved out of blocks of PER_BLOCK.
+     destroy() puts the slot on a free list to be reused.
+
+     Dropping the slab frees every block in one go without
+     running destructors, so a T kept in a slab must not own
+     memory from anywhere but other slabs or pools that are
+     dropped with it.
+
+   */
+  template<typename T, size_t PER_BLOCK = 1024>
+  class Slab {
+  private:
+    union Slot {
+      Slot* next;
+      alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::vector<Slot*> blocks;
+    Slot* free_list = nullptr;
+    size_t used = PER_BLOCK; // slots handed out of the newest block
+
+  public:
+    Slab() = default;
+
+    ~Slab() {
+      for(auto b : this->blocks) {
+        delete[] b;
+      }
+    }
+
+    Slab(const Slab&) = delete;
+    Slab& operator=(const Slab&) = delete;
+
+
+    template<typename... A>
+    T* make(A&&... args) {
+
+      Slot* s;
+
+      if(this->free_list != nullptr) {
+        s = this->free_list;
+        this->free_list = s->next;
+      } else {
+        if(this->used == PER_BLOCK) [[unlikely]] {
+          this->blocks.push_back(new Slot[PER_BLOCK]);
+          this->used = 0;
+        }
+        s = &this->blocks.back()[this->used++];
+      }
+
+      return new (s->storage) T(std::forward<A>(args)...);
+
+    }
+
+
+    void destroy(T* t) {
+      t->~T();
+
+      auto s = reinterpret_cast<Slot*>(t);
+      s->next = this->free_list;
+      this->free_list = s;
+    }
+
+  };
+
+
+
+  /**
+
+     Byte_Pool
+
+     Variable sized blocks of bytes in power of two classes
+     from MIN_CLASS to MAX_CLASS, carved out of CHUNK sized
+     allocations and recycled through a free list per class.
+     Anything bigger gets its own allocation, tracked so that
+     it is still freed with the pool.
+
+     Everything is freed at once when the pool is dropped.
+
+   */
+  class Byte_Pool {
+  public:
+    static const size_t MIN_CLASS = 64;
+    static const size_t MAX_CLASS = 256 << 10;
+    static const size_t CHUNK = 1 << 20;
+
+  private:
+    static const int CLASSES = 13; // 64 .. 256K
+
+    struct Free {
+      Free* next;
+    };
+
+    // header in front of an allocation bigger than MAX_CLASS
+    struct alignas(16) Big {
+      Big* prev;
+      Big* next;
+    };
+
+    Free* free_lists[CLASSES] = {};
+    std::vector<char*> chunks;
+    char* chunk_pos = nullptr;
+    char* chunk_end = nullptr;
+    Big* big = nullptr;
+
+    static int class_of(size_t capacity);
+    void push_free(char* p, size_t capacity);
+
+  public:
+    Byte_Pool() = default;
+    ~Byte_Pool();
+
+    Byte_Pool(const Byte_Pool&) = delete;
+    Byte_Pool& operator=(const Byte_Pool&) = delete;
+
+    // the capacity allocate(n) really hands out.
+    static size_t round_up(size_t n);
+
+    char* allocate(size_t n);
+    void release(char* p, size_t n);
+  };
+
+}
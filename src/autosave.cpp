@@ -0,0 +1,78 @@
+#include "autosave.hpp"
+#include "file.hpp"
+
+#include <unistd.h>
+
+namespace files {
+
+
+  Autosaver::Autosaver(std::string path) : path(std::move(path)) {
+    this->writer = std::thread(&Autosaver::work, this);
+  }
+
+
+  Autosaver::~Autosaver() {
+
+    {
+      std::lock_guard<std::mutex> g(this->lock);
+      this->stopping = true;
+      this->pending.reset();
+    }
+
+    this->wake.notify_all();
+    this->writer.join();
+
+  }
+
+
+  void Autosaver::submit(std::unique_ptr<Snapshot> snap) {
+
+    {
+      std::lock_guard<std::mutex> g(this->lock);
+      this->pending = std::move(snap);
+    }
+
+    this->wake.notify_all();
+
+  }
+
+
+  void Autosaver::discard() {
+
+    std::unique_lock<std::mutex> g(this->lock);
+    this->pending.reset();
+
+    // a write in progress would put the swap file back.
+    this->wake.wait(g, [this]() { return !this->busy; });
+
+    unlink(this->path.c_str());
+
+  }
+
+
+  void Autosaver::work() {
+
+    std::unique_lock<std::mutex> g(this->lock);
+
+    while(true) {
+      this->wake.wait(g, [this]() { return this->stopping || this->pending; });
+
+      if(this->stopping)
+        return;
+
+      auto snap = std::move(this->pending);
+      this->busy = true;
+
+      // written without the lock, submit() never waits on the disk.
+      g.unlock();
+      snap->write(this->path.c_str());
+      snap.reset();
+      g.lock();
+
+      this->busy = false;
+      this->wake.notify_all();
+    }
+
+  }
+
+}
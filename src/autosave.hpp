@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace files {
+
+  struct Snapshot;
+
+
+  /**
+
+     Autosaver
+
+     writes snapshots of a file to its swap file on a thread
+     of its own, so a slow disk or a big file never holds up
+     typing. Only the newest snapshot matters: one handed in
+     while an older one is waiting replaces it.
+
+     The file the snapshots read from must outlive the
+     autosaver.
+
+   */
+  class Autosaver {
+  private:
+    std::string path; // the swap file
+
+    std::unique_ptr<Snapshot> pending;
+    bool busy = false;    // a snapshot is being written
+    bool stopping = false;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread writer;
+
+    void work();
+
+  public:
+    Autosaver(std::string path);
+    ~Autosaver(); // finishes the write in progress, drops what is pending
+
+    Autosaver(const Autosaver&) = delete;
+    Autosaver& operator=(const Autosaver&) = delete;
+
+    void submit(std::unique_ptr<Snapshot> snap);
+
+    // forget pending snapshots and remove the swap file, after
+    // the file itself was saved.
+    void discard();
+  };
+
+}
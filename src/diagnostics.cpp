@@ -0,0 +1,161 @@
+#include "diagnostics.hpp"
+#include "terminal.hpp"
+
+#include <cstdio>
+#include <format>
+
+namespace editor {
+
+  static const char* phase_names[] = {"input", "dispatch", "draw", "display", "draw_rows"};
+
+
+  void Diagnostics::begin(phase_t p) {
+    if(!this->active())
+      return;
+
+    // prompts draw from inside a key's dispatch, that time is the key's.
+    if(p == DISPLAY && !this->open[DRAW])
+      return;
+
+    this->open[p] = true;
+    this->began[p] = clock::now();
+  }
+
+
+  void Diagnostics::end(phase_t p) {
+    if(!this->open[p])
+      return;
+
+    this->open[p] = false;
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - this->began[p]).count();
+    this->add(p, this->began[p], ns);
+  }
+
+
+  void Diagnostics::add(phase_t p, clock::time_point start, uint64_t ns) {
+    if(!this->active())
+      return;
+
+    this->current.ns[p] += ns;
+
+    if(this->tracing && this->events.size() < max_events) {
+      const uint64_t ts = std::chrono::duration_cast<std::chrono::nanoseconds>(start - this->started).count();
+      this->events.push_back({p, ts, ns});
+    }
+  }
+
+
+  void Diagnostics::keys(size_t n) {
+    this->current.keys += n;
+  }
+
+
+  /**
+     frame_done
+
+     the io counters are read every frame, shown or not, so
+     the first frame after turning the overlay on only holds
+     its own bytes.
+   */
+  void Diagnostics::frame_done() {
+
+    const auto& io = terminal::io_stats();
+
+    this->current.bytes = io.bytes_out - this->bytes_at;
+    this->current.syscalls = io.syscalls - this->syscalls_at;
+    this->bytes_at = io.bytes_out;
+    this->syscalls_at = io.syscalls;
+
+    if(this->active()) {
+      if(this->frames.size() < window)
+        this->frames.push_back(this->current);
+      else
+        this->frames[this->next] = this->current;
+      this->next = (this->next + 1) % window;
+
+      if(this->tracing && this->frame_events.size() < max_events) {
+        const uint64_t ts = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - this->started).count();
+        this->frame_events.push_back({ts, this->current});
+      }
+    }
+
+    this->current = frame_t();
+
+  }
+
+
+  std::string Diagnostics::summary() {
+
+    if(this->frames.empty())
+      return "";
+
+    frame_t sum;
+    for(const auto& f : this->frames) {
+      for(int p = 0; p < PHASES; p++)
+        sum.ns[p] += f.ns[p];
+      sum.bytes += f.bytes;
+      sum.syscalls += f.syscalls;
+      sum.keys += f.keys;
+    }
+
+    const double n = this->frames.size();
+    auto ms = [&](phase_t p) { return sum.ns[p] / n / 1e6; };
+
+    return std::format("in {:.2f} key {:.2f} draw {:.2f} (display {:.2f}) rows {:.2f} ms"
+                       " | {:.0f} B/frame {:.1f} syscalls/key",
+                       ms(INPUT), ms(DISPATCH), ms(DRAW), ms(DISPLAY), ms(DRAW_ROWS),
+                       sum.bytes / n,
+                       sum.keys > 0 ? (double) sum.syscalls / sum.keys : 0.0);
+
+  }
+
+
+  void Diagnostics::trace_to(const char* path) {
+    this->trace_path = path;
+    this->tracing = true;
+  }
+
+
+  /**
+     dump_trace
+
+     a complete ("X") event per phase and a counter ("C") event
+     per frame, times in microseconds:
+
+       {"traceEvents": [
+         {"name": "draw", "ph": "X", "ts": 1520.3, "dur": 310.2, "pid": 1, "tid": 1},
+         {"name": "frame", "ph": "C", "ts": 1840.0, "pid": 1, "tid": 1,
+          "args": {"bytes": 812, "syscalls": 4, "keys": 1}}, ...
+       ]}
+   */
+  bool Diagnostics::dump_trace() {
+
+    if(!this->tracing)
+      return true;
+
+    FILE* out = fopen(this->trace_path.c_str(), "w");
+    if(out == nullptr)
+      return false;
+
+    const char* sep = "";
+    fprintf(out, "{\"traceEvents\": [");
+
+    for(const auto& e : this->events) {
+      fprintf(out, "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1}",
+              sep, phase_names[e.phase], e.ts_ns / 1e3, e.dur_ns / 1e3);
+      sep = ",";
+    }
+
+    for(const auto& [ts, f] : this->frame_events) {
+      fprintf(out, "%s\n  {\"name\": \"frame\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"tid\": 1,"
+              " \"args\": {\"bytes\": %lu, \"syscalls\": %lu, \"keys\": %zu}}",
+              sep, ts / 1e3, (unsigned long) f.bytes, (unsigned long) f.syscalls, f.keys);
+      sep = ",";
+    }
+
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0;
+
+  }
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace editor {
+
+  /**
+
+     Diagnostics
+
+     where the time of each turn of TUI_Editor::run() goes,
+     kept for the last few dozen frames:
+
+       wait_events()   handle_key()...   draw()              draw_rows()
+       |-- input --|---- dispatch ----|-- display() --|...|-- draw_rows --|
+                                      |------- draw -------|
+
+     input leaves out the time spent asleep waiting for a key.
+     Next to the timings go the bytes sent to the terminal per
+     frame and the syscalls made per key, all from
+     terminal::io_stats().
+
+     Nothing is measured unless the overlay is shown or a
+     trace is being kept. The trace is Chrome's JSON format,
+     open it in chrome://tracing or ui.perfetto.dev.
+
+   */
+  class Diagnostics {
+  public:
+    enum phase_t { INPUT, DISPATCH, DRAW, DISPLAY, DRAW_ROWS, PHASES };
+
+    bool overlay = false; // averages on the status line
+
+    bool active() { return this->overlay || this->tracing; }
+
+    void begin(phase_t p);
+    void end(phase_t p);
+
+    // a phase timed by someone else, i.e. input less the sleep.
+    void add(phase_t p, std::chrono::steady_clock::time_point start, uint64_t ns);
+
+    void keys(size_t n);
+    void frame_done(); // after draw_rows(), closes the frame
+    std::string summary();
+
+    void trace_to(const char* path);
+    bool dump_trace(); // false if it can't be written
+
+    class Scope {
+    public:
+      Scope(Diagnostics& d, phase_t p) : d(d), p(p) { d.begin(p); }
+      ~Scope() { d.end(p); }
+    private:
+      Diagnostics& d;
+      phase_t p;
+    };
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    typedef struct frame {
+      uint64_t ns[PHASES] = {};
+      uint64_t bytes = 0;
+      uint64_t syscalls = 0;
+      size_t keys = 0;
+    } frame_t;
+
+    typedef struct event {
+      phase_t phase;
+      uint64_t ts_ns; // since started
+      uint64_t dur_ns;
+    } event_t;
+
+    static const size_t window = 64;     // frames averaged
+    static const size_t max_events = 1 << 20;
+
+    frame_t current;
+    std::vector<frame_t> frames;         // ring of the last window
+    size_t next = 0;
+
+    bool open[PHASES] = {};
+    clock::time_point began[PHASES];
+    uint64_t bytes_at = 0, syscalls_at = 0;
+
+    bool tracing = false;
+    std::string trace_path;
+    clock::time_point started = clock::now();
+    std::vector<event_t> events;
+    std::vector<std::pair<uint64_t, frame_t>> frame_events; // counters
+  };
+
+}
@@ -4,7 +4,9 @@
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <unistd.h>
 
+#include "diagnostics.hpp"
 #include "file.hpp"
 #include "terminal.hpp"
 #include <format>
@@ -19,11 +21,14 @@ namespace editor {
 
 
   typedef std::unordered_map<char, std::function<void()>> keymap_t;
+
+  // called with the text of a prompt every time it changes
+  typedef std::function<void(const std::string&)> input_hook_t;
   
   
   class Editor {
   protected:
-    files::Editor_File* openFile;
+    files::Editor_File* openFile = nullptr;
     std::unordered_map<std::string, files::Editor_File*> Files;
     bool cmd_mode = false;
     std::string mod_line;
@@ -36,6 +41,7 @@ namespace editor {
     ~Editor() = default;
 
     keymap_t keymap;
+    keymap_t alt_keymap; // keys pressed with ALT (or after ESC)
 
     virtual coord_t get_cursor_position() = 0;
 
@@ -60,10 +66,23 @@ namespace editor {
     virtual void new_line() = 0;
     virtual void end() = 0;
     virtual void home() = 0;
+    virtual void undo() = 0;
+    virtual void redo() = 0;
+    virtual void search(bool forward, bool regex = false) = 0;
+    virtual void replace_all() = 0;
+    virtual void go_to(bool offset) = 0; // prompt for a line number, or a byte offset
 
     
     
-    virtual std::string get_user_input(std::string prompt) = 0;
+    /**
+       get_user_input
+
+       prompt for a line of text. changed() sees the text as it
+       is typed and keys bound in `keys` run instead of being
+       typed.
+     */
+    virtual std::string get_user_input(std::string prompt, input_hook_t changed = nullptr,
+                                       const keymap_t* keys = nullptr) = 0;
     virtual void put_status_line(std::string msg) = 0;
 
 
@@ -72,6 +91,8 @@ namespace editor {
     }
     
     virtual void open_file(std::string path) {
+      bool close = false;
+
       if(this->openFile != nullptr) {
 
         auto in = this->get_user_input("Save Current Buffer? [Y/n]");
@@ -81,18 +102,41 @@ namespace editor {
         }
 
         in = this->get_user_input("Close Current Buffer? [y/N]");
-        if((in == "y" || in == "yes" || in == "Y" || in == "Yes")) {
-          delete this->openFile;
-        } 
+        close = (in == "y" || in == "yes" || in == "Y" || in == "Yes");
         
       }
 
-      this->openFile = new files::Editor_File(path);
+      // a swap file newer than the file holds edits that were
+      // never saved, most likely from a session that died. Asked
+      // while the old buffer is still there to draw.
+      std::string recover;
+      if(files::Editor_File::has_swap(path)) {
+        auto in = this->get_user_input("Recover unsaved changes from the swap file? [Y/n]");
+
+        if(!(in == "n" || in == "no" || in == "N" || in == "No")) {
+          recover = files::Editor_File::swap_path(path);
+        } else {
+          unlink(files::Editor_File::swap_path(path).c_str());
+        }
+      }
+
+      if(close)
+        this->close_file();
+
+      this->openFile = new files::Editor_File(path, recover);
       this->Files[this->openFile->filename] = this->openFile;
     }
 
-    void save(std::string path) {
-      this->openFile->save_as(path.c_str());
+    // drop the open buffer, out of Files first: the main loop
+    // walks them all.
+    virtual void close_file() {
+      this->Files.erase(this->openFile->filename);
+      delete this->openFile;
+      this->openFile = nullptr;
+    }
+
+    bool save(std::string path) {
+      return this->openFile->save_as(path.c_str());
     }
 
 
@@ -131,17 +175,20 @@ namespace editor {
 
   class Frame {
   public:
-    files::Editor_File::Line* start;
-    files::Editor_File::Line* end;
+    files::Editor_File* file;
     int size;
     int start_line_number;
     int end_line_number;
     
-    Frame(files::Editor_File::Line* ctx, size_t N, int ctx_line);
+    Frame(files::Editor_File* file, size_t N, int ctx_line);
     void scroll_up(int lines);
     void scroll_down(int lines);
+    void show(int line); // scroll just enough for line to be on screen
+    void center(int line); // put line in the middle of the screen
     void display();
 
+    int rows_between(int from, int to); // screen rows lines [from, to) wrap onto
+
     void new_line_hook(bool last_line);
     void remove_line_hook();
     
@@ -155,9 +202,13 @@ namespace editor {
 
 
     void draw();
+    bool handle_key(const terminal::key_event_t& key);
+    bool handle_char(char c);
+    void paste(const std::string& text);
     
   public:
-    Frame* f;
+    Frame* f = nullptr;
+    Diagnostics diag; // alt-d shows it, see Diagnostics
     TUI_Editor();
 
     coord_t get_cursor_position() override;
@@ -172,17 +223,25 @@ namespace editor {
     void home() override;
     void new_line() override;
     void delete_char() override;
+    void undo() override;
+    void redo() override;
+    void search(bool forward, bool regex = false) override;
+    void replace_all() override;
+    void go_to(bool offset) override;
+    void set_render_mode(terminal::render_mode_t mode);
         
     void run() override;
     void put_status_line(std::string msg) override;
 
 
     void open_file(std::string path) override;
+    void close_file() override;
     void switch_buffer(int index) override;
     
     void sync_cursors();
 
-    std::string get_user_input(std::string prompt) override;
+    std::string get_user_input(std::string prompt, input_hook_t changed = nullptr,
+                               const keymap_t* keys = nullptr) override;
     
   };
 
@@ -203,10 +262,16 @@ namespace editor {
     void delete_char() override;
     void end() override;
     void home() override;
+    void undo() override;
+    void redo() override;
+    void search(bool forward, bool regex = false) override;
+    void replace_all() override;
+    void go_to(bool offset) override;
 
 
     void put_status_line(std::string msg) override;
-    std::string get_user_input(std::string prompt) override;
+    std::string get_user_input(std::string prompt, input_hook_t changed = nullptr,
+                               const keymap_t* keys = nullptr) override;
     void new_line() override;
 
   };
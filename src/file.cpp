@@ -1,248 +1,1158 @@
 #include "file.hpp"
+#include "autosave.hpp"
 #include "gap_buffer.hpp"
-
-#include <fstream>
+#include "line_index.hpp"
+#include "regex.hpp"
+#include "search.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
 
 namespace files {
 
 
 
-  Editor_File::Editor_File(std::string filename) {
-    using std::fstream;
+  Editor_File::Editor_File(std::string filename, std::string recover_from) {
+
+    // a recovered file reads the swap but keeps its own name,
+    // and starts out unsaved.
+    if(!recover_from.empty())
+      this->version = 1;
 
-    fstream infile(filename);
+    if(!this->source.open(recover_from.empty() ? filename : recover_from)) {
 
-    if(!infile.is_open()) {
- 
-      this->head = new Line("", 0);
-      this->head->Next = nullptr;
-      this->head->Prev = nullptr;
-      this->context = this->head;
-      this->tail = this->head;
+      this->line_tree.insert(0, this->arena.make("", 0));
+      this->context = this->line_at(0);
 
+      this->size = 0;
       this->lines = 1;
       this->current_context_line = 0;
       this->filename = "*" + filename;
-      
+
       return;
     }
 
-    int lines = 0;
-
-    Line* t_next;
-    Line* t_prev = this->head;
-    
-    for (std::string s; std::getline(infile, s); ) {
-      this->context = new Line(s.c_str(), s.length());
-
-      if (lines == 0) [[unlikely]] {
-        this->context->Prev = nullptr;
-        this->head = this->context;
-      } else {
-        this->context->Prev = t_prev;
-        t_prev->Next = this->context;
-      }
-     
-
+    // only find where each line starts, the Line nodes
+    // are made as they are reached (see Line_Tree::at).
+    this->line_index.push_back(0);
 
-      t_prev = this->context;
-      this->context = this->context->Next;
-      lines++;
+    if(this->source.size > INDEX_CHUNK_SIZE) {
+      // big files are indexed in the background, wait for the
+      // first chunk to have a screen to draw, lines fills in as
+      // poll_index() collects the rest.
+      this->indexer = std::make_unique<Line_Indexer>(this->source.data, this->source.size, INDEX_CHUNK_SIZE);
+      this->indexer->collect(this->line_index, true);
+    } else {
+      find_newlines(this->source.data, this->source.size, 0, this->line_index);
     }
 
-    this->tail = this->context;
-    this->context = this->head;
+    this->finish_index();
 
-    infile.close();
+    this->line_tree.attach(this->source.data, this->source.size, &this->line_index);
+    this->line_tree.append_run(0, this->line_index.size());
 
     this->filename = filename;
-    this->lines = lines;
+    this->size = this->source.size;
+    this->lines = this->line_tree.size();
     this->current_context_line = 0;
-    
+    this->context = this->line_at(0);
+
   }
 
 
-  Editor_File::~Editor_File() {
-    auto togo = this->head->Next;
-    
-    for(this->context = this->head;
-        togo != nullptr; ) {
+  Editor_File::~Editor_File() = default;
+
+
+  bool Editor_File::poll_index(bool wait) {
+
+    if(this->indexer == nullptr)
+      return true;
+
+    const auto before = this->line_index.size();
+    this->indexer->collect(this->line_index, wait);
+
+    this->finish_index();
+
+    const auto added = this->line_index.size() - before;
+    this->line_tree.append_run(before, added);
+    this->lines += added;
+
+    return this->indexer == nullptr;
+
+  }
+
 
-      delete this->context;
-      this->context = togo;
-      togo = this->context->Next;
-      
+  void Editor_File::finish_index() {
+
+    if(this->indexer != nullptr) {
+      if(!this->indexer->done())
+        return;
+
+      this->indexer.reset();
     }
-    
+
+    // a trailing newline ends the last line, it doesn't start one.
+    if(this->line_index.size() > 1 && this->line_index.back() == this->source.size) {
+      this->line_index.pop_back();
+    }
+
+    this->line_index.shrink_to_fit();
+
   }
 
 
 
+  void Editor_File::goto_line(size_t n) {
+
+    if(n >= this->lines)
+      n = this->lines - 1;
+
+    this->context = this->line_at(n);
+    this->current_context_line = n;
+
+    // typing after moving away is a new undo step.
+    this->journal.seal();
+
+  }
+
+
+  uint64_t Editor_File::cursor_offset() {
+    return this->line_tree.offset_of_line(this->current_context_line)
+      + this->context->cursor_position();
+  }
+
+
+  void Editor_File::goto_offset(uint64_t offset) {
+    const auto line = this->line_tree.line_of_offset(offset);
+    this->goto_line(line);
+
+    const auto start = this->line_tree.offset_of_line(this->current_context_line);
+    this->context->move_cursor_to(offset > start ? offset - start : 0);
+  }
+
+
   void Editor_File::next_line() {
-    auto togo = this->context->Next;
-    if (togo != nullptr) {
-      this->context = togo;
-      this->current_context_line++;
+    if (this->has_next()) {
+      this->goto_line(this->current_context_line + 1);
     }
   }
 
   void Editor_File::prev_line() {
-    auto togo = this->context->Prev;
-    if (togo != nullptr) {
-      this->context = togo;
-      this->current_context_line--;
+    if (this->has_prev()) {
+      this->goto_line(this->current_context_line - 1);
     }
-    
-    
   }
 
   void Editor_File::forward() {
-    this->context->buf->increment_cursor();
+    this->context->move_cursor_to(this->context->next_char_position());
+    this->journal.seal();
   }
 
   void Editor_File::backward() {
-    this->context->buf->decrement_cursor();
+    this->context->move_cursor_to(this->context->prev_char_position());
+    this->journal.seal();
   }
 
   void Editor_File::write_char(char c) {
 
-    // if the current buffer is full then
-    // create a new one and link it.
+    // the gap buffer grows when full so a long line
+    // stays a single Line.
+    this->version++;
+    this->journal.inserted(this->cursor_offset(), &c, 1);
+    this->context->edit()->insert(c);
+    this->line_tree.resized(this->current_context_line);
 
-    /**
+  }
 
-       V------------p    
-                    n ------>
-       a            b
-       n------------^
-       p
 
-       
-       
-     */
-    
-    if(this->context->buf->full()) [[unlikely]] {
-      auto ctx_next = this->context->Next;
+  void Editor_File::delete_char() {
+    const auto before = this->context->before_cursor();
+    if(before.empty())
+      return;
 
-      // create a new node set the previous value and next according
-      this->context->Next = new Line(&c, 1);
-      this->context->Next->Prev = this->context;
-      this->context->Next->Next = ctx_next;
+    // a whole character, however many bytes it takes.
+    const size_t n = prev_char_length(before, before.size());
 
+    this->version++;
+    this->journal.erased(this->cursor_offset() - n, before.data() + before.size() - n, n);
+    this->context->edit()->free(n);
+    this->line_tree.resized(this->current_context_line);
+  }
 
-      ctx_next->Prev = this->context->Next;
 
-      // advance context into new buffer
-      this->next_line();
+  /**
+     Save_Writer
 
-      this->lines++;
-      
-    } else {
-      this->context->buf->insert(c);
+     gathers the pieces of a save into one iovec batch and
+     hands it to writev when full, so a save is a few large
+     writes whatever the lines look like.
+
+     Text that is still exactly as it is in the opened file
+     is given as a span of it instead. Touching spans are
+     merged and copied file to file with copy_file_range,
+     which shares the blocks outright on filesystems that
+     can (btrfs, xfs). Where it can't the span is written
+     from the mapping like everything else.
+
+       [ span 0..4096 ][ "edited\n" ][ span 4103..9999 ]
+         copy_file_range   writev       copy_file_range
+   */
+  struct Save_Writer {
+    int fd;
+    const char* data = nullptr; // the opened file
+    int src_fd = -1;            // and its descriptor, -1 if there is none
+
+    Save_Writer(int fd, const char* data, int src_fd) : fd(fd), data(data), src_fd(src_fd) {}
+
+    bool ok = true;
+    bool copy = true; // copy_file_range works between these two
+
+    uint64_t begin = 0; // span of the opened file waiting to go out
+    uint64_t end = 0;
+
+    int n = 0;
+    struct iovec iov[IOV_MAX];
+
+    void add(const char* p, size_t len) {
+      if(len == 0)
+        return;
+      this->extent();
+      this->push(p, len);
     }
-    
-    
-  }
 
+    void add_source(uint64_t b, uint64_t e) {
+      if(b == e)
+        return;
+      if(this->end != this->begin && b == this->end) {
+        this->end = e;
+        return;
+      }
+      this->extent();
+      this->begin = b;
+      this->end = e;
+    }
 
-  void Editor_File::save_as(const char* path) {
+    void finish() {
+      this->extent();
+      this->flush();
+    }
 
-    using std::ofstream;
+    void push(const char* p, size_t len) {
+      if(this->n == IOV_MAX)
+        this->flush();
+      this->iov[this->n++] = {const_cast<char*>(p), len};
+    }
 
-    ofstream out;
+    void extent() {
+
+      if(this->begin == this->end)
+        return;
+
+      loff_t off = this->begin;
+      const uint64_t e = this->end;
+      this->begin = this->end = 0;
+
+      if(this->copy && this->src_fd >= 0) {
+        // what is batched goes first, the copy lands after it.
+        this->flush();
+
+        while(this->ok && (uint64_t) off < e) {
+          ssize_t c = copy_file_range(this->src_fd, &off, this->fd, nullptr, e - off, 0);
+          if(c > 0)
+            continue;
+          if(c < 0 && errno == EINTR)
+            continue;
+          if(c == 0 || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL) {
+            this->copy = false;
+            break;
+          }
+          this->ok = false;
+        }
+      }
 
-    out.open(path);
+      if((uint64_t) off < e)
+        this->push(this->data + off, e - off);
 
-    auto prev_context = this->context;
-    
-    this->context = this->head;
-    while(this->context != nullptr) {
+    }
 
-      for(auto c : *this->context->buf) {
-        out << c;
+    void flush() {
+      struct iovec* v = this->iov;
+      int count = this->n;
+
+      while(this->ok && count > 0) {
+        ssize_t w = writev(this->fd, v, count);
+        if(w < 0) {
+          if(errno == EINTR)
+            continue;
+          this->ok = false;
+          break;
+        }
+
+        // partial write, skip what went out and go again.
+        while(count > 0 && (size_t) w >= v->iov_len) {
+          w -= v->iov_len;
+          v++;
+          count--;
+        }
+        if(count > 0) {
+          v->iov_base = static_cast<char*>(v->iov_base) + w;
+          v->iov_len -= w;
+        }
       }
-      
-      this->context = this->context->Next;
 
-      out << '\n';
-      
+      this->n = 0;
     }
+  };
 
 
-    this->context = prev_context;
-    out.close();
-    
+  /**
+     emit
+
+     feed the text of f to a sink, which has add(bytes) for
+     text that only exists in memory and add_source(begin, end)
+     for spans of the opened file. Dirty lines are their two
+     gap buffer halves, everything else is a span of the file:
+     the runs never reached and the lines read but not changed.
+   */
+  template<typename Sink>
+  static void emit(Editor_File* f, Sink& out) {
+
+    static const char newline = '\n';
+    const auto& source = f->source;
+
+    f->line_tree.for_each([&](Line_Tree::Node* t) {
+
+      if(t->line != nullptr && (t->line->dirty || source.data == nullptr)) {
+        auto a = t->line->before_cursor();
+        auto b = t->line->after_cursor();
+        out.add(a.data(), a.size());
+        out.add(b.data(), b.size());
+        out.add(&newline, 1);
+        return;
+      }
+
+      // unchanged text, the line and its newline as they are
+      // in the file.
+      auto span = t->line != nullptr
+        ? std::pair<uint64_t, uint64_t>(t->line->src - source.data,
+                                        std::min<uint64_t>(t->line->src - source.data + t->line->src_len + 1,
+                                                           source.size))
+        : f->line_tree.run_span(t);
+
+      out.add_source(span.first, span.second);
+
+      if(span.second == source.size && span.second > span.first
+         && source.data[span.second - 1] != '\n')
+        out.add(&newline, 1);
+
+    });
+
   }
 
 
-  void Editor_File::save() {
-    this->save_as(this->filename.c_str());
+  /**
+     replace_file
+
+     fill() writes the new text to a temporary file next to
+     `path` which is synced and then renamed over it, so a
+     crash leaves either the old file or the new one, never
+     half of each.
+   */
+  template<typename F>
+  static bool replace_file(const char* path, const char* data, int src_fd, F fill) {
+
+    // through a symlink it is the file it points at that is
+    // replaced, not the link. A new file has nothing to resolve.
+    std::string target = path;
+    char resolved[PATH_MAX];
+    if(realpath(path, resolved) != nullptr)
+      target = resolved;
+
+    const auto slash = target.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : target.substr(0, slash + 1);
+    std::string tmp = (slash == std::string::npos ? "" : dir) + ".alter-XXXXXX";
+
+    const int fd = mkstemp(tmp.data());
+    if(fd < 0)
+      return false;
+
+    // keep the permissions of the file being replaced, a new
+    // one gets what creating it would have: 0666 less the umask.
+    struct stat st;
+    if(stat(target.c_str(), &st) == 0) {
+      fchmod(fd, st.st_mode & 07777);
+    } else if(errno == ENOENT) {
+      const mode_t mask = umask(0);
+      umask(mask);
+      fchmod(fd, 0666 & ~mask);
+    }
+
+    Save_Writer out(fd, data, src_fd);
+    fill(out);
+    out.finish();
+
+    if(!out.ok || fsync(fd) != 0) {
+      ::close(fd);
+      unlink(tmp.c_str());
+      return false;
+    }
+
+    ::close(fd);
+
+    // the mapping still holds the old file, renaming over it is safe.
+    if(rename(tmp.c_str(), target.c_str()) != 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+
+    // make the rename itself durable.
+    const int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(dfd >= 0) {
+      fsync(dfd);
+      ::close(dfd);
+    }
+
+    return true;
+
+  }
+
+
+  /**
+     save_as
+
+     only dirty lines are serialised, with one line edited a
+     save is two copies and a short write. Saving to the
+     file's own name also retires its swap file.
+   */
+  bool Editor_File::save_as(const char* path) {
+
+    // lines the background index hasn't reached yet are
+    // not in the tree, they have to be before it is written.
+    while(!this->poll_index(true));
+
+    const bool ok = replace_file(path, this->source.data, this->source.fd, [this](Save_Writer& out) {
+      emit(this, out);
+    });
+
+    if(ok && this->disk_name() == path) {
+      this->saved = this->autosaved = this->version;
+      if(this->autosaver)
+        this->autosaver->discard();
+      else
+        unlink(swap_path(this->disk_name()).c_str());
+    }
+
+    return ok;
+
+  }
+
+
+  /**
+     snapshot
+
+     copy out what autosave needs to write the file later on
+     another thread: the bytes of dirty lines, and spans of
+     the opened file (which never changes under us) for the
+     rest. Nothing in it points into the line tree.
+   */
+  std::unique_ptr<Snapshot> Editor_File::snapshot() {
+
+    auto snap = std::make_unique<Snapshot>();
+    snap->data = this->source.data;
+    snap->src_fd = this->source.fd;
+
+    emit(this, *snap);
+
+    return snap;
+
+  }
+
+
+  void Snapshot::add(const char* p, size_t len) {
+    if(len == 0)
+      return;
+
+    const uint64_t at = this->text.size();
+    this->text.append(p, len);
+
+    if(!this->pieces.empty() && !this->pieces.back().source && this->pieces.back().end == at) {
+      this->pieces.back().end += len;
+      return;
+    }
+    this->pieces.push_back({false, at, at + len});
+  }
+
+
+  void Snapshot::add_source(uint64_t begin, uint64_t end) {
+    if(begin == end)
+      return;
+
+    if(!this->pieces.empty() && this->pieces.back().source && this->pieces.back().end == begin) {
+      this->pieces.back().end = end;
+      return;
+    }
+    this->pieces.push_back({true, begin, end});
+  }
+
+
+  bool Snapshot::write(const char* path) const {
+    return replace_file(path, this->data, this->src_fd, [this](Save_Writer& out) {
+      for(const auto& p : this->pieces) {
+        if(p.source)
+          out.add_source(p.begin, p.end);
+        else
+          out.add(this->text.data() + p.begin, p.end - p.begin);
+      }
+    });
+  }
+
+
+  void Editor_File::autosave() {
+
+    // the tree is missing lines until indexing is done.
+    if(this->version == this->autosaved || this->indexing())
+      return;
+
+    if(!this->autosaver)
+      this->autosaver = std::make_unique<Autosaver>(swap_path(this->disk_name()));
+
+    this->autosaver->submit(this->snapshot());
+    this->autosaved = this->version;
+
+  }
+
+
+  std::string Editor_File::swap_path(const std::string& path) {
+    const auto slash = path.rfind('/');
+    if(slash == std::string::npos)
+      return "." + path + ".alter-swap";
+    return path.substr(0, slash + 1) + "." + path.substr(slash + 1) + ".alter-swap";
+  }
+
+
+  bool Editor_File::has_swap(const std::string& path) {
+    struct stat swap, file;
+    if(stat(swap_path(path).c_str(), &swap) != 0)
+      return false;
+    if(stat(path.c_str(), &file) != 0)
+      return true;
+    return swap.st_mtim.tv_sec > file.st_mtim.tv_sec
+      || (swap.st_mtim.tv_sec == file.st_mtim.tv_sec && swap.st_mtim.tv_nsec >= file.st_mtim.tv_nsec);
+  }
+
+
+  bool Editor_File::save() {
+    return this->save_as(this->filename.c_str());
   }
 
 
   void Editor_File::new_line() {
 
-    auto ctx_next = this->context->Next;
+    this->version++;
+
+    // each line typed is its own undo step.
+    this->journal.inserted(this->cursor_offset(), "\n", 1);
+    this->journal.seal();
 
-    const char* empty = "";
-    auto content = this->context->buf->get_post_gap();
-    
-    // create a new node set the previous value and next according
-    this->context->Next =
-      new Line(content.c_str(), content.length());
+    auto content = this->context->after_cursor();
+    auto line = this->arena.make(content.data(), content.length());
 
-    this->context->buf->trim_post_gap();
-    
-    this->context->Next->Prev = this->context;
-    this->context->Next->Next = ctx_next;
-    
+    this->context->edit()->trim_post_gap();
+    this->line_tree.resized(this->current_context_line);
 
-    if(ctx_next != nullptr) 
-      ctx_next->Prev = this->context->Next;
+    this->line_tree.insert(this->current_context_line + 1, line);
     this->lines++;
 
     // You will need to manually advance onto the newline
 
-    
-    
+  }
+
+
+  /**
+     insert_text
+
+     insert a block at the cursor in one go, the cursor ends
+     up after it. The block is split on newlines once; every
+     line it creates goes into the tree in a single insert.
+     The lines in the middle are views of one copy of the
+     block kept by the arena, same as untouched file lines.
+     Returns how many lines were added.
+
+       ab|cd  + "x\ny\nz"  ->  abx
+                               y
+                               z|cd
+   */
+  size_t Editor_File::insert_text(const char* text, size_t len) {
+
+    this->version++;
+
+    // a block is one undo step of its own.
+    this->journal.seal();
+    this->journal.inserted(this->cursor_offset(), text, len);
+    this->journal.seal();
+
+    std::vector<uint64_t> breaks;
+    files::find_newlines(text, len, 0, breaks);
+
+    auto buf = this->context->edit();
+
+    if(breaks.empty()) {
+      buf->insert(text, len);
+      this->line_tree.resized(this->current_context_line);
+      return 0;
+    }
+
+    // what follows the cursor moves to the end of the last line.
+    std::string tail(this->context->after_cursor());
+    buf->trim_post_gap();
+    buf->insert(text, breaks[0] - 1);
+    this->line_tree.resized(this->current_context_line);
+
+    char* copy = this->arena.bytes.allocate(len);
+    memcpy(copy, text, len);
+
+    std::vector<Line*> made;
+    made.reserve(breaks.size());
+
+    for(size_t i = 0; i < breaks.size(); i++) {
+      const size_t begin = breaks[i];
+      const size_t end = i + 1 < breaks.size() ? breaks[i + 1] - 1 : len;
+      made.push_back(this->arena.mapped(copy + begin, end - begin));
+      made.back()->dirty = true; // not text of the file on disk
+    }
+
+    auto last = made.back();
+    const size_t column = last->length();
+    if(!tail.empty()) {
+      auto last_buf = last->edit();
+      last_buf->put_cursor_end();
+      last_buf->insert(tail.data(), tail.size());
+    }
+    last->move_cursor_to(column);
+
+    this->line_tree.insert(this->current_context_line + 1, made.data(), made.size());
+
+    this->lines += made.size();
+    this->current_context_line += made.size();
+    this->context = last;
+
+    return made.size();
+
   }
 
 
   void Editor_File::remove_line() {
 
-    if(this->context == nullptr) {
+    // remove this->context, joining it onto the line before.
+
+    if(!this->has_prev()) {
       return;
     }
-    
-    // remove this->context.
 
-    auto prev = this->context->Prev;
+    this->version++;
+    this->journal.erased(this->line_tree.offset_of_line(this->current_context_line) - 1, "\n", 1);
+
+    auto prev = this->line_at(this->current_context_line - 1);
+
+    prev->edit()->put_cursor_end();
+    const auto join = prev->cursor_position();
+    auto content = this->context->get_chars();
+    prev->buf->insert(content.c_str(), content.length());
+    prev->move_cursor_to(join);
+
+    this->line_tree.erase(this->current_context_line);
+
+    this->current_context_line--;
+    this->lines--;
+
+    this->context = prev;
+    this->line_tree.resized(this->current_context_line);
 
-    if(prev == nullptr) {
+  }
+
+
+  void Editor_File::erase_text(size_t n) {
+
+    this->version++;
+
+    const auto offset = this->cursor_offset();
+    const auto column = this->context->cursor_position();
+    const auto after = this->context->after_cursor();
+
+    // all on this line
+    if(n <= after.size()) {
+      this->journal.erased(offset, after.data(), n);
+      this->context->edit()->erase(n);
+      this->line_tree.resized(this->current_context_line);
       return;
     }
-    
-    auto next = this->context->Next;
-    
-    prev->buf->put_cursor_end();
-    for(auto c : this->context->get_chars())
-      prev->buf->insert(c);
-    
-    delete this->context;
 
-    this->current_context_line--;
+    // past the end of this line, every newline crossed joins
+    // the next line on. What is left of the last one reached
+    // becomes the end of this line.
+    std::string gone(after);
+    std::string tail;
+    size_t left = n - after.size();
+    size_t joined = 0;
+
+    while(left > 0 && this->current_context_line + joined + 1 < this->lines) {
+      gone += '\n';
+      left--;
+      joined++;
+
+      auto text = this->line_at(this->current_context_line + joined)->get_chars();
+      const size_t take = std::min(left, text.size());
+      gone.append(text, 0, take);
+      tail = text.substr(take);
+      left -= take;
+    }
 
-    prev->Next = next;
+    this->journal.erased(offset, gone.data(), gone.size());
 
+    auto buf = this->context->edit();
+    buf->trim_post_gap();
+    buf->insert(tail.data(), tail.size());
+    buf->move_gap_to(column);
 
-    if(next != nullptr) {
-      next->Prev = prev;
-      this->context = prev;
-    } else {
-      this->context = prev;
+    this->line_tree.erase(this->current_context_line + 1, joined);
+    this->lines -= joined;
+    this->line_tree.resized(this->current_context_line);
+
+  }
+
+
+  /**
+     find
+
+     the tree is walked from the node holding `from` and each
+     node searched where its text is: runs straight out of the
+     mapping as one block (so a big untouched file is a single
+     scan), lines as the two halves either side of their gap.
+   */
+  bool Editor_File::find(std::string_view needle, uint64_t from, bool forward, uint64_t& at) {
+
+    if(needle.empty())
+      return false;
+
+    return this->line_tree.visit_from(from, forward, [&](Line_Tree::Node* t, uint64_t offset) {
+
+      std::string_view a, b;
+
+      if(t->line != nullptr) {
+        a = t->line->before_cursor();
+        b = t->line->after_cursor();
+      } else {
+        auto span = this->line_tree.run_span(t);
+        a = std::string_view(this->source.data + span.first, span.second - span.first);
+      }
+
+      size_t r;
+      if(forward) {
+        r = find_split(a, b, needle, from > offset ? from - offset : 0);
+      } else {
+        r = rfind_split(a, b, needle, from - offset);
+      }
+
+      if(r == npos)
+        return false;
+
+      at = offset + r;
+      return true;
+
+    });
+
+  }
+
+
+  /**
+     match_line
+
+     a regex match in one line of text (a + b) that starts at
+     file offset `base`. Forward takes the first match at or
+     after `from`, backward the last one starting before it.
+   */
+  static bool match_line(Matcher& m, std::string_view a, std::string_view b, uint64_t base,
+                         uint64_t from, bool forward, uint64_t& at, size_t& length) {
+
+    const size_t len = a.size() + b.size();
+    size_t begin, end;
+
+    if(forward) {
+      const size_t start = from > base ? from - base : 0;
+      if(start > len || !m.search(a, b, start, begin, end))
+        return false;
+
+      at = base + begin;
+      length = end - begin;
+      return true;
+    }
+
+    bool found = false;
+    for(size_t start = 0; start <= len && base + start < from && m.search(a, b, start, begin, end); ) {
+      if(base + begin >= from)
+        break;
+
+      at = base + begin;
+      length = end - begin;
+      found = true;
+      start = end > begin ? end : begin + 1;
+    }
+
+    return found;
+
+  }
+
+
+  /**
+     find_regex
+
+     like find, but a run is split into its lines first since
+     a match never crosses a newline.
+   */
+  bool Editor_File::find_regex(Matcher& m, uint64_t from, bool forward, uint64_t& at, size_t& length) {
+
+    return this->line_tree.visit_from(from, forward, [&](Line_Tree::Node* t, uint64_t offset) {
+
+      if(t->line != nullptr)
+        return match_line(m, t->line->before_cursor(), t->line->after_cursor(),
+                          offset, from, forward, at, length);
+
+      auto span = this->line_tree.run_span(t);
+      const char* p = this->source.data + span.first;
+      const size_t n = span.second - span.first;
+
+      auto line = [&](size_t begin) {
+        auto nl = static_cast<const char*>(memchr(p + begin, '\n', n - begin));
+        return std::string_view(p + begin, (nl ? nl - p : n) - begin);
+      };
+
+      if(forward) {
+        // back up to the start of the line holding `from`.
+        size_t begin = from > offset ? from - offset : 0;
+        auto nl = begin ? static_cast<const char*>(memrchr(p, '\n', begin)) : nullptr;
+        begin = nl ? nl - p + 1 : 0;
+
+        while(begin < n) {
+          auto text = line(begin);
+          if(match_line(m, text, {}, offset + begin, from, true, at, length))
+            return true;
+          begin += text.size() + 1;
+        }
+        return false;
+      }
+
+      // the line holding the last byte before `from`, then up.
+      for(size_t end = std::min<uint64_t>(from - offset, n); end > 0; ) {
+        auto nl = end > 1 ? static_cast<const char*>(memrchr(p, '\n', end - 1)) : nullptr;
+        const size_t begin = nl ? nl - p + 1 : 0;
+
+        if(match_line(m, line(begin), {}, offset + begin, from, false, at, length))
+          return true;
+        end = begin;
+      }
+      return false;
+
+    });
+
+  }
+
+
+  // a + b with every match replaced, false if nothing matched.
+  static bool replace_line(Matcher& m, std::string_view a, std::string_view b,
+                           std::string_view with, std::string& out, size_t& count) {
+
+    const size_t len = a.size() + b.size();
+    size_t start = 0, kept = 0, found = 0, begin, end;
+
+    auto copy = [&](size_t from, size_t to) {
+      if(from >= to)
+        return;
+      if(from < a.size())
+        out.append(a.substr(from, std::min(to, a.size()) - from));
+      if(to > a.size())
+        out.append(b.substr(std::max(from, a.size()) - a.size(), to - std::max(from, a.size())));
+    };
+
+    out.clear();
+
+    while(start <= len && m.search(a, b, start, begin, end)) {
+      copy(kept, begin);
+      out.append(with);
+      found++;
+
+      // an empty match keeps the byte after it and moves on,
+      // one at the end ($, x*) leaves nothing to keep.
+      if(end == begin) {
+        kept = std::min(begin + 1, len);
+        copy(begin, kept);
+        start = begin + 1;
+      } else {
+        start = kept = end;
+      }
     }
-       
+
+    if(found == 0)
+      return false;
+
+    copy(kept, len);
+    count += found;
+    return true;
+
+  }
+
+
+  /**
+     replace_all
+
+     matching is spread over threads, replacing is not. The
+     file is cut into pieces at line boundaries (each Line on
+     its own, runs in chunks of lines) and every
+     thread takes pieces with its own Matcher, producing the
+     new text of the lines that change. Those are then put in
+     in order, one erase and one insert record per line, all
+     inside one journal step so a single undo puts it back.
+   */
+  size_t Editor_File::replace_all(const Regex& re, std::string_view with) {
+
+    // runs read the line index, it must be complete.
+    while(!this->poll_index(true));
+
+    typedef struct piece {
+      size_t line;           // line number of the first line
+      std::string_view a, b; // one Line (a + b), or lines of a run (a)
+      bool run;
+    } piece_t;
+
+    typedef struct change {
+      size_t line;
+      std::string text;
+    } change_t;
+
+    std::vector<piece_t> pieces;
+    size_t line = 0;
+
+    this->line_tree.for_each([&](Line_Tree::Node* t) {
+
+      if(t->line != nullptr) {
+        pieces.push_back({line, t->line->before_cursor(), t->line->after_cursor(), false});
+        line++;
+        return;
+      }
+
+      const size_t chunk_lines = 16384;
+      for(size_t i = 0; i < t->count; i += chunk_lines) {
+        const size_t first = t->first + i;
+        const size_t last = std::min(first + chunk_lines, t->first + t->count);
+        const uint64_t begin = this->line_index[first];
+        const uint64_t end = last < this->line_index.size() ? this->line_index[last] : this->source.size;
+        pieces.push_back({line + i, std::string_view(this->source.data + begin, end - begin), {}, true});
+      }
+      line += t->count;
+
+    });
+
+    std::vector<std::vector<change_t>> changes(pieces.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> total{0};
+
+    auto work = [&]() {
+      Matcher m(&re);
+      std::string out;
+      size_t count = 0;
+
+      for(size_t i; (i = next++) < pieces.size(); ) {
+        const auto& pc = pieces[i];
+
+        if(!pc.run) {
+          if(replace_line(m, pc.a, pc.b, with, out, count))
+            changes[i].push_back({pc.line, out});
+          continue;
+        }
+
+        const char* p = pc.a.data();
+        const size_t n = pc.a.size();
+        size_t l = pc.line;
+
+        for(size_t begin = 0; begin < n; l++) {
+          auto nl = static_cast<const char*>(memchr(p + begin, '\n', n - begin));
+          const size_t end = nl ? nl - p : n;
+
+          if(replace_line(m, std::string_view(p + begin, end - begin), {}, with, out, count))
+            changes[i].push_back({l, out});
+
+          begin = end + 1;
+        }
+      }
+
+      total += count;
+    };
+
+    const unsigned threads = std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()), pieces.size());
+
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < threads; i++)
+      workers.emplace_back(work);
+    work();
+    for(auto& t : workers)
+      t.join();
+
+    if(total == 0)
+      return 0;
+
+    const size_t here = this->current_context_line;
+    const size_t column = this->context->cursor_position();
+
+    this->version++;
+    this->journal.begin_step();
+
+    // lines changed one after another come out of the tree together.
+    size_t first = 0, count = 0;
+    for(auto& piece : changes) {
+      for(auto& c : piece) {
+        if(count > 0 && c.line == first + count) {
+          count++;
+          continue;
+        }
+        this->line_tree.expand(first, count);
+        first = c.line;
+        count = 1;
+      }
+    }
+    this->line_tree.expand(first, count);
+
+    line = 0;
+
+    // one walk over the tree in order puts the new text in,
+    // every subtree total is brought up to date after.
+    size_t p = 0, k = 0;
+    uint64_t offset = 0; // where the node starts in the new text
+
+    this->line_tree.for_each([&](Line_Tree::Node* t) {
+
+      while(p < changes.size() && k == changes[p].size()) {
+        p++;
+        k = 0;
+      }
+
+      if(p == changes.size() || t->line == nullptr || changes[p][k].line != line) {
+        offset += t->bytes;
+        line += t->count;
+        return;
+      }
+
+      auto l = t->line;
+      const auto& text = changes[p][k++].text;
+
+      if(l->buf == nullptr) {
+        // still a view, it becomes a view of the new text.
+        this->journal.erased(offset, l->src, l->src_len);
+        char* copy = this->arena.bytes.allocate(text.size());
+        memcpy(copy, text.data(), text.size());
+        l->src = copy;
+        l->src_len = text.size();
+        l->cursor = 0;
+        l->dirty = true;
+      } else {
+        auto buf = l->buf;
+        buf->move_gap_to(0);
+        this->journal.erased(offset, buf->post_gap().data(), buf->post_gap().size());
+        buf->erase(buf->post_gap().size());
+        buf->insert(text.data(), text.size());
+      }
+
+      l->invalidate();
+
+      this->journal.inserted(offset, text.data(), text.size());
+
+      offset += text.size() + 1;
+      line++;
+
+    });
+
+    this->line_tree.refresh();
+
+    this->journal.end_step();
+
+    this->goto_line(here);
+    this->context->move_cursor_to(column);
+
+    return total;
+
+  }
+
+
+  /**
+     undo
+
+     revert every record of the last step, newest first. The
+     edits that do it are not journaled themselves, the
+     records stay put for redo.
+   */
+  bool Editor_File::undo() {
+
+    uint64_t step;
+    auto r = this->journal.undo(step);
+    if(r == nullptr)
+      return false;
+
+    this->journal.recording = false;
+
+    while(r != nullptr) {
+      this->goto_offset(r->offset);
+
+      if(r->insert) {
+        this->erase_text(r->length);
+      } else {
+        auto b = this->journal.bytes(r);
+        this->insert_text(b.data(), b.size());
+      }
+
+      auto next = this->journal.peek_undo();
+      r = next && next->step == step ? this->journal.undo(step) : nullptr;
+    }
+
+    this->journal.recording = true;
+    return true;
+
   }
-  
-  
+
+
+  bool Editor_File::redo() {
+
+    uint64_t step;
+    auto r = this->journal.redo(step);
+    if(r == nullptr)
+      return false;
+
+    this->journal.recording = false;
+
+    while(r != nullptr) {
+      this->goto_offset(r->offset);
+
+      if(r->insert) {
+        auto b = this->journal.bytes(r);
+        this->insert_text(b.data(), b.size());
+      } else {
+        this->erase_text(r->length);
+      }
+
+      auto next = this->journal.peek_redo();
+      r = next && next->step == step ? this->journal.redo(step) : nullptr;
+    }
+
+    this->journal.recording = true;
+    return true;
+
+  }
+
 }
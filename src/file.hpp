@@ -1,12 +1,51 @@
 #pragma once
 
-#include "gap_buffer.hpp"
+#include "journal.hpp"
+#include "line.hpp"
+#include "line_index.hpp"
+#include "line_tree.hpp"
+#include "mapped_file.hpp"
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
-
-#define GAP_BUFFER_SIZE 512
+// files bigger than this are indexed in chunks of this size on a thread pool.
+#define INDEX_CHUNK_SIZE (8 << 20)
 
 namespace files {
+
+  class Autosaver;
+  class Regex;
+  class Matcher;
+
+
+  /**
+     Snapshot
+
+     the text of a file at one moment, in a form another
+     thread can write out: copied bytes for what exists only
+     in memory and spans of the opened file for the rest.
+   */
+  struct Snapshot {
+
+    typedef struct piece {
+      bool source;     // a span of the opened file, or of text
+      uint64_t begin;
+      uint64_t end;
+    } piece_t;
+
+    const char* data = nullptr; // the opened file
+    int src_fd = -1;
+    std::vector<piece_t> pieces;
+    std::string text;
+
+    void add(const char* p, size_t len);
+    void add_source(uint64_t begin, uint64_t end);
+    bool write(const char* path) const;
+  };
+
   
   /**
 
@@ -14,67 +53,49 @@ namespace files {
 
      This is how a file is represented.
 
-     Each file is a linked list of lines
-     each line is either
+     Each file is a tree of lines (see Line_Tree)
+     each line is either a view of the mapped file
+     or, once modified, a gap buffer.
+
+     Opening only indexes where lines start, Line
+     nodes are made as they are first reached.
      
    */
     class Editor_File {
     public:
-      struct Line {
-        
-        buffers::Gap_Buffer<GAP_BUFFER_SIZE>* buf;
-        Line* Next = nullptr;
-        Line* Prev = nullptr;
-
-        int wrapping = 0;
-
-        
-        Line(const char *b, unsigned int N) {
-            buf = new buffers::Gap_Buffer<GAP_BUFFER_SIZE>();
-            buf->load(b, N);
-        }
-
-        ~Line() {
-          if(buf != nullptr) {
-            delete buf;
-          }          
-        }
-
-
-        std::string get_chars() {
-          std::string r;
- 
-          r.reserve(GAP_BUFFER_SIZE);
-          for(auto c : *buf) {
-            r.push_back(c);
-          }
-         
-          return r;
-          
-        }
-        
-        
-      };
-
-
-      Line* head; // First Line and Head of the files
-      Line* tail; //  Tail of the linked list and last line
+      using Line = files::Line;
+
+
+      Mapped_File source; // the file as it was opened
+      std::vector<uint64_t> line_index; // offset of the start of each line in source
+      std::unique_ptr<Line_Indexer> indexer; // fills line_index for big files, nullptr once done
+
+      Line_Arena arena; // Line nodes and their buffers, freed in bulk
+      Line_Tree line_tree{&arena}; // every line, by line number
       Line* context; // Context = Line currently being looked at.
-      
+      Journal journal; // undo / redo history
+
       std::string filename; // filename
-      unsigned int size; // size of the file (realtime?)
-      unsigned int lines; // number of lines in the file (realtime?)
-      unsigned int current_context_line; // line number of the current context.
+      size_t size; // size of the file (realtime?)
+      size_t lines; // number of lines in the file (realtime?)
+      size_t current_context_line; // line number of the current context.
+
+      uint64_t version = 0;   // bumped by every edit
+      uint64_t saved = 0;     // version last written to filename
+      uint64_t autosaved = 0; // version last handed to the autosaver
+      std::unique_ptr<Autosaver> autosaver; // declared last, its thread stops first
       
       
-      Editor_File(std::string filename);
-      ~Editor_File(); // make sure to follow the linked list and not leave floating objects
+      // recover_from: read the text from this (swap) file instead
+      Editor_File(std::string filename, std::string recover_from = "");
+      ~Editor_File();
 
 
-      void save();
-      void save_as(const char* path);
+      bool save(); // false if the file could not be written
+      bool save_as(const char* path);
       
       void write_char(char c);
+      void delete_char();
       
       void next_line();
       void prev_line();
@@ -84,13 +105,64 @@ namespace files {
 
       void new_line();
       void remove_line();
+      size_t insert_text(const char* text, size_t len);
+      void erase_text(size_t n); // n bytes after the cursor, newlines included
+
+      bool undo(); // false when there is nothing to undo
+      bool redo();
+
+      uint64_t cursor_offset(); // byte offset of the cursor in the file
+      void goto_offset(uint64_t offset);
+
+      // offset of the first match at or after `from` (forward) or
+      // the last one starting before it, false if there is none.
+      bool find(std::string_view needle, uint64_t from, bool forward, uint64_t& at);
+      bool find_regex(Matcher& m, uint64_t from, bool forward, uint64_t& at, size_t& length);
+
+      // replace every match of re with `with` (taken literally),
+      // as one undo step. Returns how many were replaced.
+      size_t replace_all(const Regex& re, std::string_view with);
+
+      std::unique_ptr<Snapshot> snapshot();
+      void autosave(); // hand unsaved changes to the swap file writer
+
+      inline bool modified() {
+        return this->version != this->saved;
+      }
+
+      inline bool needs_autosave() {
+        return this->version != this->autosaved;
+      }
+
+      // filename without the * that marks a file not on disk yet
+      inline std::string disk_name() {
+        if(this->source.data == nullptr && !this->filename.empty() && this->filename[0] == '*')
+          return this->filename.substr(1);
+        return this->filename;
+      }
+
+      static std::string swap_path(const std::string& path);
+      static bool has_swap(const std::string& path); // a swap newer than path exists
+
+      inline Line* line_at(size_t n) {
+        return this->line_tree.at(n);
+      }
+
+      void goto_line(size_t n); // clamped to the last line
+
+      bool poll_index(bool wait = false); // collect background index chunks, true once complete
+      void finish_index();
+
+      inline bool indexing() {
+        return this->indexer != nullptr;
+      }
 
-      constexpr inline bool has_next() {
-        return this->context->Next != nullptr;
+      inline bool has_next() {
+        return this->current_context_line + 1 < this->lines;
       }
 
-      constexpr inline bool has_prev() {
-        return this->context->Prev != nullptr;
+      inline bool has_prev() {
+        return this->current_context_line > 0;
       }
       
     };
@@ -5,71 +5,119 @@
 namespace editor {
 
 
-  Frame::Frame(files::Editor_File::Line* ctx, size_t N, int ctx_line) {
+  Frame::Frame(files::Editor_File* file, size_t N, int ctx_line) {
 
+    this->file = file;
     start_line_number = ctx_line;
-    start = ctx;
-    end = start;
-    
-    int i = 1;
-    for(i; i <= N; i++) {
-      if(end->Next == nullptr)
-        break;
-      end = end->Next;
-    }
-    
-    size = i;
+
+    // N rows below the first, or as many lines as are left.
+    size_t left = file->lines - ctx_line;
+    size = left < N + 1 ? left : N + 1;
 
     end_line_number = ctx_line + size;
-       
+
   }
 
 
   void Frame::scroll_down(int lines) {
-    
+
     for(int i = 0; i < lines; i++) {
-      if(end->Next == nullptr)
+      if(static_cast<size_t>(end_line_number + 1) >= file->lines)
         break;
 
-      if(start == nullptr)
-        break;
-      
-      start = start->Next;
+      // kept in step here as well as in display(), several
+      // keys can be applied between two frames.
       start_line_number++;
-      
+      end_line_number++;
+
     }
-    
+
   }
 
 
   void Frame::scroll_up(int lines) {
 
-    if(start == nullptr || end == nullptr)
-      return;
-    
     for(int i = 0; i < lines; i++) {
 
-      if(start->Prev == nullptr)
+      if(start_line_number == 0)
         break;
 
-      start = start->Prev;
       start_line_number--;
-      
+      end_line_number--;
+
     }
   }
 
-  void Frame::display() {
-        
-    int i = start_line_number;
-
-    for(auto ptr = start; ptr != nullptr && i < (size + start_line_number); ptr = ptr->Next, i++) {
-      auto line_num = std::format("\033[37;44m{:04}\033[0m ", i);      
-      terminal::put_str(line_num.c_str(), line_num.length());
-      terminal::put_line_obj(ptr);
-      this->end = ptr;
-      this->end_line_number = i;
+  /**
+     show
+
+     after a jump (undo, paste) the cursor line can be anywhere.
+     Move the frame the least to have it on screen, keeping one
+     row spare at the bottom like next_line() does, and size it
+     to the lines now in the file.
+   */
+  void Frame::show(int line) {
+
+    const int rows = terminal::get_terminal_size().second - 2;
+
+    if(line < start_line_number)
+      start_line_number = line;
+    else if(line > start_line_number + rows - 2)
+      start_line_number = line - rows + 2;
+
+    if(start_line_number < 0)
+      start_line_number = 0;
+
+    // wrapped lines above can still push it off the bottom.
+    int used = this->rows_between(start_line_number, line + 1);
+    while(start_line_number < line && used > rows - 1) {
+      used -= this->rows_between(start_line_number, start_line_number + 1);
+      start_line_number++;
     }
-            
+
+    const size_t left = file->lines - start_line_number;
+    size = left < static_cast<size_t>(rows) ? left : rows;
+
+    end_line_number = start_line_number + size - 1;
+
+  }
+
+
+  /**
+     center
+
+     for a jump far away: showing the target on the bottom row
+     hides what follows it, put it halfway down instead.
+   */
+  void Frame::center(int line) {
+    const int rows = terminal::get_terminal_size().second - 2;
+
+    this->start_line_number = line - rows / 2;
+    this->show(line);
+  }
+
+
+  int Frame::rows_between(int from, int to) {
+    const auto cols = terminal::wrap_width();
+    int rows = 0;
+
+    for(int i = from; i < to && static_cast<size_t>(i) < file->lines; i++)
+      rows += file->line_at(i)->display_rows(cols);
+
+    return rows;
+  }
+
+
+  void Frame::display() {
+
+    const int rows = terminal::get_terminal_size().second - 2;
+    const int to = std::min<size_t>(file->lines, size + start_line_number);
+
+    // wrapped lines use up the rows sooner.
+    const int drawn = terminal::put_lines(file, start_line_number, to, rows);
+    if(drawn > 0)
+      this->end_line_number = start_line_number + drawn - 1;
+
   }
 
 
@@ -91,7 +139,7 @@ namespace editor {
     auto rows = terminal::get_terminal_size().second;
 
 
-    if(this->start->Prev == nullptr)
+    if(this->start_line_number == 0)
       return;
     
     if(this->size < rows - 2) {
@@ -2,11 +2,15 @@
 #pragma once
 
 #include <string.h>
-
-// TODO
+#include <cstddef>
+#include <string>
+#include <string_view>
 
 #include <iostream>
 
+#include "arena.hpp"
+#include "utf8.hpp"
+
 /**
 
    Implement a gap buffer here.
@@ -22,22 +26,31 @@
 namespace buffers {
 
 
+  /**
+     Gap_Buffer
+
+     SIZE is the starting capacity, not a limit. When the gap
+     closes the buffer is reallocated with (at least) double the
+     capacity so a run of inserts costs amortized O(1) per byte.
+   */
   template<const unsigned int SIZE = 512>
   class Gap_Buffer {
   private:
     char* buffer;   // ptr to the start of the buffer
-    char* buffer_end; // end of the buffer
-    char *gap_start; // gap start
-    char *gap_end; // end of gap
+    char* buffer_end; // end of the buffer (one past the last byte)
+    char *gap_start; // gap start (first byte of the gap)
+    char *gap_end; // end of gap (one past the last byte of the gap)
 
     
-    unsigned int gap = SIZE; // size of the gap
+    size_t gap = SIZE; // size of the gap
+
+    Byte_Pool* pool = nullptr; // where the bytes come from, nullptr for new[]
     
     /**
 
        
-       [b, -, -  gs, -, -, -, ,ge,-, be]
-       [a, b, c, d|,           e, f, g]
+       [b, -, -  gs, -, -, -, ge, -, be]
+       [a, b, c, d|,          e, f, g]
                   ^ cursor
 
       Size = 10
@@ -45,43 +58,100 @@ namespace buffers {
      */
     
     
+    // from the pool when there is one, it may round capacity up.
+    char* allocate(size_t& capacity) {
+      if(this->pool) {
+        capacity = Byte_Pool::round_up(capacity);
+        return this->pool->allocate(capacity);
+      }
+      return new char[capacity];
+    }
+
+    void release(char* b, size_t capacity) {
+      if(this->pool) {
+        this->pool->release(b, capacity);
+      } else {
+        delete[] b;
+      }
+    }
+
+
+    /**
+       grow
+
+       reallocate so that the gap can hold at least `needed`
+       more bytes. Capacity at least doubles, the text before
+       the gap stays at the front and the text after it is moved
+       to the back of the new block.
+     */
+    void grow(size_t needed) {
+
+      const size_t capacity = this->buffer_end - this->buffer;
+      const size_t pre = this->gap_start - this->buffer;
+      const size_t post = this->buffer_end - this->gap_end;
+
+      size_t new_capacity = capacity ? capacity * 2 : SIZE;
+      while(new_capacity - pre - post < needed) {
+        new_capacity *= 2;
+      }
+
+      char* nb = this->allocate(new_capacity);
+      memcpy(nb, this->buffer, pre);
+      memcpy(nb + new_capacity - post, this->gap_end, post);
+
+      this->release(this->buffer, capacity);
+
+      this->buffer = nb;
+      this->buffer_end = nb + new_capacity;
+      this->gap_start = nb + pre;
+      this->gap_end = this->buffer_end - post;
+      this->gap = this->gap_end - this->gap_start;
+    }
+
+
   public:
 
-    unsigned int strlen = 0;
+    size_t strlen = 0;
     
-    Gap_Buffer() {
-      this->buffer = new char[SIZE];
-      this->buffer_end = this->buffer + SIZE;
+    Gap_Buffer(size_t capacity = SIZE, Byte_Pool* pool = nullptr) {
+      this->pool = pool;
+      this->buffer = this->allocate(capacity);
+      this->buffer_end = this->buffer + capacity;
       this->gap_start = this->buffer;
       this->gap_end = this->buffer_end;
+      this->gap = capacity;
     }
     
     ~Gap_Buffer() {
-      delete this->buffer;
+      this->release(this->buffer, this->buffer_end - this->buffer);
     }
 
+    Gap_Buffer(const Gap_Buffer&) = delete;
+    Gap_Buffer& operator=(const Gap_Buffer&) = delete;
+
     
 
-    bool load(char const* inbuffer, unsigned int size) {
+    bool load(char const* inbuffer, size_t size) {
 
-      if (size > SIZE) [[unlikely]] {
-        return false;
+      // keep a full SIZE gap spare after loading so the first
+      // edits on a long line don't immediately reallocate.
+      if (size > this->gap) [[unlikely]] {
+        this->grow(size + SIZE);
       }
      
+      /**
+         text is loaded after the gap so the cursor starts
+         at home.
      
-      memcpy(this->buffer, inbuffer, size);
+         * * * * * a b c d e
+         ^
+       */
+
+      this->gap_end -= size;
+      memcpy(this->gap_end, inbuffer, size);
       
       this->gap -= size;
       this->strlen += size;
-      this->gap_start = this->buffer + size + 1;
-
-      /**
-         1 2 3 4 5
-         V V V V V
-         a b c d e *
-                   ^
-       */
-
 
       this->put_cursor_home();
       
@@ -90,22 +160,24 @@ namespace buffers {
     }
 
 
+    void reserve(size_t capacity) {
+      const size_t current = this->buffer_end - this->buffer;
+      if(capacity > current) {
+        this->grow(capacity - current + this->gap);
+      }
+    }
+
+
     void increment_cursor() {
 
       //          start       end
       // [         v           v      }  
       // [a, b, c, -, -, -. -. -, d, e]
       //
-      // 1.1 : if start is the end of the buffer
-      //       may read beyond the buffer. The buffer is therefore
-      //       full or an error in setting the gap.
-      // 1.2 : if the end is at the buffer end then the gap is
-      //       as far as it can go left.
-
-      if (this->gap_start == this->buffer_end)
-        return;
+      // 1 : if the end is at the buffer end then there is
+      //     nothing after the cursor to move over.
 
-      if (this->gap_end == this->buffer_end - 1)
+      if (this->gap_end == this->buffer_end)
         return;
       
 
@@ -114,27 +186,26 @@ namespace buffers {
       // [a, b, c, -, -, -. -. -, d, e]
       //
 
-      // 2 : swap the values of start and end.
-      //   : The end doesn't /need/ to be updated it can be
-      //     overwritten when needed.
-      // 2.2: if the start == end it will perform a useless swap
+      // 2 : move the first byte after the gap to the start of it.
+      //   : The old slot doesn't /need/ to be cleared it is
+      //     gap now and will be overwritten when needed.
 
-      *this->gap_start = *(this->gap_end + 1);
+      *this->gap_start = *this->gap_end;
       
-      //         start        end
-      // [         v           v      }
+      //            start        end
+      // [            v           V   }
       // [a, b, c, d, -, -. -. -, d, e]
       //
 
 
-      // 3 : increment pointers. it is not at the end
+      // 3 : increment pointers.
       this->gap_end++;
       this->gap_start++;
       
-      //            start        end
-      // [            v           V   }
-      // [a, b, c, d, -, -. -. -, -, e]
-      //
+      // 4 : the rest of a UTF-8 character goes over with it,
+      //     the cursor never stops inside one.
+      while(this->gap_end != this->buffer_end && files::is_continuation(*this->gap_end))
+        *this->gap_start++ = *this->gap_end++;
      
     }
 
@@ -149,27 +220,24 @@ namespace buffers {
       
       //               start        end
       // [               v           v}
-      // [a, b, c, d, e, -. -. -, -, -]
-      //              ^----->>-->>---^
-
-      
-      if (this->gap_end  == this->buffer)
-        return;
+      // [a, b, -. -. -, c, d, -, -, -]
+      //
 
       if (this->gap_start == this->buffer)
         return;
       
       this->gap_start--; 
+      this->gap_end--;
 
-      // 2: swap end and start
+      // 2: move the byte before the gap to the end of it.
       //    start is just considered gap and will
       //    be overwritten when needed.
 
       *this->gap_end = *this->gap_start;
 
-
-      // 3: decrement end
-      this->gap_end--;   
+      // 3: back to the first byte of a UTF-8 character.
+      while(files::is_continuation(*this->gap_end) && this->gap_start != this->buffer)
+        *--this->gap_end = *--this->gap_start;
       
     }
    
@@ -179,7 +247,7 @@ namespace buffers {
       for(auto *ptr = this->buffer; ptr != this->buffer_end; ptr++) {
 
        
-        if(ptr >= this->gap_start && ptr <= this->gap_end) {
+        if(ptr >= this->gap_start && ptr < this->gap_end) {
           std::cout << '*';
         } else {
           std::cout << *ptr;
@@ -193,14 +261,9 @@ namespace buffers {
 
     void insert(char c) {
 
-      if(this->gap_start == this->gap_end) {
-        return;
+      if(this->gap_start == this->gap_end) [[unlikely]] {
+        this->grow(1);
       }
-
-      if(this->gap_start == this->buffer_end) {
-        return;
-      }
-
       
       *this->gap_start = c;
       this->gap_start++;
@@ -209,6 +272,20 @@ namespace buffers {
 
     }
 
+
+    void insert(char const* c, size_t N) {
+
+      if(this->gap < N) [[unlikely]] {
+        this->grow(N);
+      }
+
+      memcpy(this->gap_start, c, N);
+      this->gap_start += N;
+      this->gap -= N;
+      this->strlen += N;
+
+    }
+
     void free() {
       if(this->gap_start == this->buffer)
         return;
@@ -218,66 +295,120 @@ namespace buffers {
       this->strlen--;
     }
 
+    // remove up to n bytes before the cursor (backspace n times).
+    void free(size_t n) {
+      const size_t pre = this->gap_start - this->buffer;
+      if(n > pre)
+        n = pre;
 
-    void put_cursor_home() {
+      this->gap_start -= n;
+      this->gap += n;
+      this->strlen -= n;
+    }
 
 
-      /**
-                     gap start      gap end
-                        V             V
-         a, b, c, d, e, * * * * * * ...
-         a,b,c,d,e,*,*,*,*
-         *,*,*,*,a,b,c,d,e
+    // remove up to n bytes after the cursor (delete forward).
+    void erase(size_t n) {
+      const size_t post = this->buffer_end - this->gap_end;
+      if(n > post)
+        n = post;
+
+      this->gap_end += n;
+      this->gap += n;
+      this->strlen -= n;
+    }
          
          
-       */
+    /**
+       move_gap_to
 
+       place the cursor at `position` (clamped to the text length)
+       by moving the bytes between the old and the new cursor across
+       the gap in a single memmove. Cost is O(distance) bulk copy.
 
-      while(this->gap_start != this->buffer) {
-        decrement_cursor();
+            move_gap_to(1)
+       [a, b, c, -, -, d]  ->  [a, -, -, b, c, d]
+     */
+    void move_gap_to(size_t position) {
+
+      const size_t pre = this->gap_start - this->buffer;
+      const size_t len = pre + (this->buffer_end - this->gap_end);
+
+      if(position > len)
+        position = len;
+
+      if(position < pre) {
+        const size_t n = pre - position;
+        this->gap_start -= n;
+        this->gap_end -= n;
+        memmove(this->gap_end, this->gap_start, n);
+      } else if(position > pre) {
+        const size_t n = position - pre;
+        memmove(this->gap_start, this->gap_end, n);
+        this->gap_start += n;
+        this->gap_end += n;
       }
      
     }
 
 
+    void put_cursor_home() {
+      this->move_gap_to(0);
+    }
+
+
     void put_cursor_end() {
-      while(this->gap_end != this->buffer_end - 1) {
-        increment_cursor();
-      }
+      this->move_gap_to(this->get_strlen());
     }
     
 
 
-    constexpr inline int getCursorPosition() {
+    constexpr inline size_t getCursorPosition() {
       return this->gap_start- this->buffer;
     }
     
     constexpr inline char const* get_buffer_end() {
-      return this->buffer + SIZE;
+      return this->buffer_end;
     }
 
     constexpr inline char const* get_buffer_start() {
       return this->buffer;
     }
 
+    constexpr inline size_t capacity() {
+      return this->buffer_end - this->buffer;
+    }
+
     constexpr inline bool full() {
       return (this->gap_start == this->gap_end);
     }
 
 
+    // the two contiguous runs of text either side of the gap
+    inline std::string_view pre_gap() {
+      return std::string_view(this->buffer, this->gap_start - this->buffer);
+    }
+
+    inline std::string_view post_gap() {
+      return std::string_view(this->gap_end, this->buffer_end - this->gap_end);
+    }
+
+
     // returns everything after the cursor
     inline std::string get_post_gap() {
-      return std::string(this->gap_end + 1, this->buffer_end);
+      return std::string(this->gap_end, this->buffer_end);
     }
 
     // trims everything after the cursor.
     void trim_post_gap() {
-      this->gap_end = this->buffer_end - 1;
+      this->strlen -= this->buffer_end - this->gap_end;
+      this->gap += this->buffer_end - this->gap_end;
+      this->gap_end = this->buffer_end;
     }
 
 
     // getstrlen
-    inline int get_strlen() {
+    inline size_t get_strlen() {
       return (this->gap_start - this->buffer)
         + (this->buffer_end - this->gap_end);
     }
@@ -291,13 +422,13 @@ namespace buffers {
 
       iterator& operator++() {
         ++ptr;
-        if (ptr == owner->gap_start) ptr = owner->gap_end + 1;
+        if (ptr == owner->gap_start) ptr = owner->gap_end;
         return *this;
        }
 
       iterator(Gap_Buffer<SIZE> *o, char* p) : owner(o), ptr(p) {
         if(ptr == owner->gap_start)
-          ptr = owner->gap_end + 1;
+          ptr = owner->gap_end;
       }
 
 
@@ -0,0 +1,224 @@
+#include "journal.hpp"
+
+#include <algorithm>
+
+namespace files {
+
+
+  void Journal::inserted(uint64_t offset, const char* b, size_t n) {
+    this->add(offset, b, n, true);
+  }
+
+
+  void Journal::erased(uint64_t offset, const char* b, size_t n) {
+    this->add(offset, b, n, false);
+  }
+
+
+  void Journal::seal() {
+    this->close();
+  }
+
+
+  // the last record is done growing.
+  void Journal::close() {
+
+    if(!this->records.empty() && this->records.back().reversed) {
+      auto& last = this->records.back();
+      const auto from = this->log.begin() + (last.start - this->log_base);
+      std::reverse(from, from + last.length);
+      last.reversed = false;
+    }
+
+    this->open = false;
+
+  }
+
+
+  void Journal::begin_step() {
+    if(this->grouped++ == 0) {
+      this->next_step++;
+      this->close();
+    }
+  }
+
+
+  void Journal::end_step() {
+    if(this->grouped > 0 && --this->grouped == 0)
+      this->close();
+  }
+
+
+  /**
+     add
+
+     typing extends the last record when it carries straight
+     on from it:
+
+       insert at the end of the last insert   abc| + d
+       erase just before the last erase       (backspace)
+       erase at the same offset as the last   (delete forward)
+
+     anything else starts a new record.
+   */
+  void Journal::add(uint64_t offset, const char* b, size_t n, bool insert) {
+
+    if(!this->recording || n == 0)
+      return;
+
+    this->drop_redo();
+
+    if(this->open && !this->records.empty()) {
+      auto& last = this->records.back();
+
+      if(last.insert == insert) {
+
+        if(insert && offset == last.offset + last.length) {
+          this->log.append(b, n);
+          last.length += n;
+          return;
+        }
+
+        if(!insert && offset + n == last.offset) {
+          // kept back to front, no shifting the record's bytes.
+          if(!last.reversed) {
+            const auto from = this->log.begin() + (last.start - this->log_base);
+            std::reverse(from, from + last.length);
+            last.reversed = true;
+          }
+          this->log.append(std::reverse_iterator(b + n), std::reverse_iterator(b));
+          last.offset = offset;
+          last.length += n;
+          return;
+        }
+
+        if(!insert && offset == last.offset && !last.reversed) {
+          this->log.append(b, n);
+          last.length += n;
+          return;
+        }
+      }
+    }
+
+    this->close();
+
+    // outside a group every record is its own step.
+    if(this->grouped == 0)
+      this->next_step++;
+
+    record_t r;
+    r.offset = offset;
+    r.start = this->log_base + this->log.size();
+    r.length = n;
+    r.step = this->next_step;
+    r.insert = insert;
+
+    this->log.append(b, n);
+    this->records.push_back(r);
+    this->applied = this->records.size();
+    this->open = true;
+
+    this->trim();
+
+  }
+
+
+  void Journal::drop_redo() {
+
+    if(this->applied == this->records.size())
+      return;
+
+    this->log.resize(this->records[this->applied].start - this->log_base);
+    this->records.erase(this->records.begin() + this->applied, this->records.end());
+    this->close();
+
+  }
+
+
+  size_t Journal::memory() {
+    const size_t dead = this->records.empty() ? this->log.size()
+      : this->records.front().start - this->log_base;
+    return this->log.size() - dead + this->records.size() * sizeof(record_t);
+  }
+
+
+  /**
+     trim
+
+     forget the oldest steps until the history fits in limit.
+     The log is only compacted once most of it is dead, so
+     dropping a record doesn't move every byte after it.
+   */
+  void Journal::trim() {
+
+    // the newest step is always kept, however big.
+    while(this->memory() > this->limit && this->applied > 0
+          && this->records.front().step != this->records.back().step) {
+      const auto step = this->records.front().step;
+      while(this->applied > 0 && this->records.front().step == step) {
+        this->records.pop_front();
+        this->applied--;
+      }
+    }
+
+    if(this->records.empty()) {
+      this->log_base += this->log.size();
+      this->log.clear();
+      this->close();
+      return;
+    }
+
+    const size_t dead = this->records.front().start - this->log_base;
+    if(dead > this->log.size() / 2) {
+      this->log.erase(0, dead);
+      this->log_base += dead;
+    }
+
+  }
+
+
+  const Journal::record_t* Journal::undo(uint64_t& step) {
+
+    if(this->applied == 0)
+      return nullptr;
+
+    this->close();
+
+    const auto r = &this->records[--this->applied];
+    step = r->step;
+    return r;
+
+  }
+
+
+  const Journal::record_t* Journal::redo(uint64_t& step) {
+
+    if(this->applied == this->records.size())
+      return nullptr;
+
+    this->close();
+
+    const auto r = &this->records[this->applied++];
+    step = r->step;
+    return r;
+
+  }
+
+
+  const Journal::record_t* Journal::peek_undo() {
+    return this->applied > 0 ? &this->records[this->applied - 1] : nullptr;
+  }
+
+
+  const Journal::record_t* Journal::peek_redo() {
+    return this->applied < this->records.size() ? &this->records[this->applied] : nullptr;
+  }
+
+
+  std::string_view Journal::bytes(const record_t* r) {
+    if(r->reversed)
+      this->close(); // only ever the last record
+    return std::string_view(this->log.data() + (r->start - this->log_base), r->length);
+  }
+
+}
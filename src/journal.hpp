@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+namespace files {
+
+
+  /**
+     Journal
+
+     undo history for one file. Every edit is a record of
+     where it happened (byte offset in the file) and the
+     bytes it inserted or removed. The bytes of all records
+     sit one after another in a single append only log, a
+     record only keeps its slice.
+
+     records: [ins 10 "abc"][del 12 "c"][ins 40 "x\ny"]
+     log:      abc          c           x\ny
+                                            ^ applied
+
+     Typing into the same run grows the last record instead of
+     adding one, and records sharing a step are undone
+     together. Backspacing gives the bytes last first, they
+     are appended as they come and the record is turned the
+     right way round once, when it closes. Records past `applied` are what redo replays,
+     a new edit drops them.
+
+     Once history needs more than `limit` bytes the oldest
+     steps are forgotten.
+   */
+  class Journal {
+  public:
+
+    typedef struct record {
+      uint64_t offset;  // where in the file the edit starts
+      uint64_t start;   // where its bytes start in the log
+      uint64_t length;  // how many bytes
+      uint64_t step;    // records of one step are undone together
+      bool insert;      // inserted or erased
+      bool reversed = false; // backspaced bytes, last first until closed
+    } record_t;
+
+    size_t limit = 64 << 20; // bytes of history to keep
+
+    void inserted(uint64_t offset, const char* b, size_t n);
+    void erased(uint64_t offset, const char* b, size_t n);
+
+    void seal();        // the next edit starts a new step
+    void begin_step();  // until end_step() every edit is one step
+    void end_step();
+
+    // the records to revert (last first) or replay (first first),
+    // nullptr when there is nothing. Each call moves one record.
+    const record_t* undo(uint64_t& step);
+    const record_t* redo(uint64_t& step);
+
+    bool can_undo() { return this->applied > 0; }
+    bool can_redo() { return this->applied < this->records.size(); }
+
+    // the next record on either side, to tell where a step ends.
+    const record_t* peek_undo();
+    const record_t* peek_redo();
+
+    std::string_view bytes(const record_t* r);
+
+    size_t memory();
+
+    bool recording = true; // off while undo/redo replays edits
+
+  private:
+    std::deque<record_t> records;
+    size_t applied = 0;  // records [0, applied) are in the file
+
+    std::string log;
+    uint64_t log_base = 0; // log position of log[0]
+
+    uint64_t next_step = 0;
+    bool open = false;     // the last record may still grow
+    int grouped = 0;       // begin_step() depth
+
+    void add(uint64_t offset, const char* b, size_t n, bool insert);
+    void close();
+    void drop_redo();
+    void trim();
+
+  };
+
+}
@@ -0,0 +1,168 @@
+#include "line.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace files {
+
+
+  void Line::make_buffer() {
+    this->buf = this->arena->buffers.make(GAP_BUFFER_SIZE, &this->arena->bytes);
+    this->buf->load(this->src, this->src_len);
+    this->buf->move_gap_to(this->cursor);
+  }
+
+
+  /**
+     measure
+
+     an ASCII line, the usual kind, is one column per byte: the
+     width is the length and the rows follow from it, after a
+     vector scan to be sure. Anything else is laid out a
+     character at a time, straight out of the two halves, and
+     where its rows break is kept for drawing and the cursor.
+     A line always takes at least one row, empty or not.
+   */
+  void Line::measure(uint32_t cols) {
+    this->wrap_cols = cols;
+
+    const auto a = this->before_cursor();
+    const auto b = this->after_cursor();
+
+    if(is_ascii(a) && is_ascii(b)) [[likely]] {
+      this->encoding = ASCII;
+    } else {
+      this->encoding = valid_utf8(a, b) ? UTF8 : BYTES;
+
+      if(this->encoding == UTF8) {
+        static std::vector<size_t> found;
+        found.clear();
+
+        this->width = 0;
+        lay_out(a, b, cols, [&](size_t at, uint32_t row, uint32_t, int w) {
+          if(row > found.size())
+            found.push_back(at);
+          this->width += w;
+          return true;
+        });
+
+        this->rows = found.size() + 1;
+        this->keep_breaks(found);
+        this->cell_at = this->cell_col = 0;
+        return;
+      }
+    }
+
+    this->width = this->length();
+    this->rows = this->width > cols ? (this->width + cols - 1) / cols : 1;
+  }
+
+
+  void Line::keep_breaks(const std::vector<size_t>& at) {
+
+    if(at.size() > this->breaks_cap) {
+      if(this->breaks != nullptr)
+        this->arena->bytes.release(reinterpret_cast<char*>(this->breaks), this->breaks_cap * sizeof(size_t));
+
+      const size_t bytes = buffers::Byte_Pool::round_up(at.size() * sizeof(size_t));
+      this->breaks = reinterpret_cast<size_t*>(this->arena->bytes.allocate(bytes));
+      this->breaks_cap = bytes / sizeof(size_t);
+    }
+
+    std::copy(at.begin(), at.end(), this->breaks);
+
+  }
+
+
+  // display columns of the characters in [from, to) of a + b.
+  static size_t width_between(std::string_view a, std::string_view b, size_t from, size_t to) {
+    size_t w = 0;
+    for(size_t i = from; i < to; ) {
+      uint32_t cp;
+      i += decode_utf8(a, b, i, cp);
+      w += char_width(cp);
+    }
+    return w;
+  }
+
+
+  /**
+     cursor_cell
+
+     a cursor just past a full row stays at the end of that
+     row rather than starting one that isn't drawn. On a UTF8
+     line the row comes from the breaks and the column from
+     adding up the row, from its start or from the last
+     answer, whichever is nearer: moving along a long row
+     that isn't wrapped costs the distance moved.
+   */
+  std::pair<uint32_t, uint32_t> Line::cursor_cell(uint32_t cols) {
+    const size_t column = this->cursor_position();
+
+    this->display_rows(cols);
+
+    if(this->encoding == UTF8) {
+      auto row_of = [&](size_t at) -> uint32_t {
+        return std::upper_bound(this->breaks, this->breaks + this->rows - 1, at) - this->breaks;
+      };
+
+      const auto a = this->before_cursor();
+      const auto b = this->after_cursor();
+      const uint32_t row = row_of(column);
+
+      size_t from = this->row_start(row);
+      size_t col = 0;
+
+      const size_t moved = this->cell_at > column ? this->cell_at - column : column - this->cell_at;
+      if(row_of(this->cell_at) == row && moved < column - from) {
+        from = this->cell_at;
+        col = this->cell_col;
+      }
+
+      if(from <= column)
+        col += width_between(a, b, from, column);
+      else
+        col -= width_between(a, b, column, from);
+
+      this->cell_at = column;
+      this->cell_col = col;
+      return {row, (uint32_t) col};
+    }
+
+    if(column > 0 && column % cols == 0 && column == this->length())
+      return {column / cols - 1, cols};
+
+    return {column / cols, column % cols};
+  }
+
+
+  Line* Line_Arena::make(const char* b, size_t N) {
+    auto l = this->lines.make();
+    l->arena = this;
+    l->dirty = true;
+    l->buf = this->buffers.make(GAP_BUFFER_SIZE, &this->bytes);
+    l->buf->load(b, N);
+    return l;
+  }
+
+
+  Line* Line_Arena::mapped(const char* b, size_t N) {
+    auto l = this->lines.make();
+    l->arena = this;
+    l->src = b;
+    l->src_len = N;
+    return l;
+  }
+
+
+  void Line_Arena::destroy(Line* l) {
+    if(l->buf != nullptr)
+      this->buffers.destroy(l->buf);
+
+    if(l->breaks != nullptr)
+      this->bytes.release(reinterpret_cast<char*>(l->breaks), l->breaks_cap * sizeof(size_t));
+
+    this->lines.destroy(l);
+  }
+
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "arena.hpp"
+#include "gap_buffer.hpp"
+#include "utf8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+// starting capacity of a line's gap buffer, it grows past this as needed.
+#define GAP_BUFFER_SIZE 512
+
+namespace files {
+
+  struct Line_Arena;
+
+  /**
+
+     Line
+
+     A line is either a view of the mapped file
+     or, once modified, a gap buffer.
+
+   */
+  struct Line {
+
+    // nullptr until the line is first modified, until then
+    // the text is read straight out of the file mapping.
+    buffers::Gap_Buffer<GAP_BUFFER_SIZE>* buf = nullptr;
+    const char* src = nullptr;
+    size_t src_len = 0;
+    size_t cursor = 0; // cursor while there is no buf
+
+    // false only while the line is still src, unchanged text of
+    // the opened file, save copies those from the file itself.
+    bool dirty = false;
+
+    // how the line sits on screen, worked out when first drawn
+    // and kept until the line is edited or the wrap width changes.
+    uint32_t wrap_cols = 0; // row width the metrics are for, 0 when stale
+    uint32_t rows = 1;      // screen rows the line wraps onto
+    size_t width = 0;       // display columns of the whole line
+
+    // what measure() found. A byte is a column unless UTF8,
+    // text that isn't valid UTF-8 is shown byte by byte.
+    enum encoding_t : uint8_t { ASCII, UTF8, BYTES };
+    encoding_t encoding = ASCII;
+
+    // UTF8 lines only: the byte where each row after the first
+    // starts, rows - 1 of them, from the arena's byte pool.
+    uint32_t breaks_cap = 0;
+    size_t* breaks = nullptr;
+
+    // the last cursor_cell() answer on a UTF8 line, the next
+    // one starts from it when that's nearer than the row start.
+    size_t cell_at = 0;  // byte
+    size_t cell_col = 0; // its column
+
+    Line_Arena* arena = nullptr; // where this line and its buffer live
+
+
+    Line() = default;
+
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+
+
+    /**
+       edit
+
+       get the gap buffer to modify the line,
+       copying the text out of the mapping on first use.
+     */
+    buffers::Gap_Buffer<GAP_BUFFER_SIZE>* edit() {
+      if(buf == nullptr) [[unlikely]] {
+        make_buffer();
+      }
+      dirty = true;
+      invalidate();
+      return buf;
+    }
+
+    void make_buffer();
+
+
+    // the text changed, the screen metrics are redone on next use.
+    void invalidate() {
+      wrap_cols = 0;
+    }
+
+    uint32_t display_rows(uint32_t cols) {
+      if(wrap_cols != cols) [[unlikely]] {
+        measure(cols);
+      }
+      return rows;
+    }
+
+    void measure(uint32_t cols);
+    void keep_breaks(const std::vector<size_t>& at);
+
+    // first byte of a row, as measured.
+    size_t row_start(uint32_t row) {
+      return row == 0 ? 0 : breaks[row - 1];
+    }
+
+    // screen row (within the line) and column of the cursor.
+    std::pair<uint32_t, uint32_t> cursor_cell(uint32_t cols);
+
+
+    size_t length() {
+      return buf ? buf->get_strlen() : src_len;
+    }
+
+    size_t cursor_position() {
+      return buf ? buf->getCursorPosition() : cursor;
+    }
+
+    void move_cursor_to(size_t position) {
+      // never inside a UTF-8 character, back to its first byte.
+      const size_t len = length();
+      if(position > len)
+        position = len;
+      while(position > 0 && position < len && is_continuation(byte_at(position)))
+        position--;
+
+      if(buf) {
+        buf->move_gap_to(position);
+      } else {
+        cursor = position;
+      }
+    }
+
+    // where the cursor goes one character, not byte, either way.
+    size_t next_char_position() {
+      return cursor_position() + next_char_length(after_cursor(), 0);
+    }
+
+    size_t prev_char_position() {
+      const auto before = before_cursor();
+      return before.size() - prev_char_length(before, before.size());
+    }
+
+    char byte_at(size_t i) {
+      const auto before = before_cursor();
+      return i < before.size() ? before[i] : after_cursor()[i - before.size()];
+    }
+
+
+    // text either side of the cursor.
+    std::string_view before_cursor() {
+      return buf ? buf->pre_gap() : std::string_view(src, cursor);
+    }
+
+    std::string_view after_cursor() {
+      return buf ? buf->post_gap() : std::string_view(src + cursor, src_len - cursor);
+    }
+
+
+    std::string get_chars() {
+      std::string r;
+
+      r.reserve(length());
+      r += before_cursor();
+      r += after_cursor();
+
+      return r;
+
+    }
+
+
+  };
+
+
+
+  /**
+
+     Line_Arena
+
+     Owns the Line nodes of a file and the bytes of their gap
+     buffers. Lines come out of slabs instead of one malloc
+     each, so lines made together sit together, and the
+     whole lot is freed in one go when the arena is dropped.
+
+   */
+  struct Line_Arena {
+    buffers::Slab<Line> lines;
+    buffers::Slab<buffers::Gap_Buffer<GAP_BUFFER_SIZE>> buffers;
+    buffers::Byte_Pool bytes;
+
+    Line* make(const char* b, size_t N);   // an edited line holding b
+    Line* mapped(const char* b, size_t N); // a view of unmodified text
+    void destroy(Line* l);
+  };
+
+}
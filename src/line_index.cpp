@@ -0,0 +1,236 @@
+#include "line_index.hpp"
+
+#include <string.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LINE_INDEX_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace files {
+
+
+  static void find_newlines_scalar(const char* data, size_t len, uint64_t base, std::vector<uint64_t>& starts) {
+
+    const char* end = data + len;
+
+    for(auto p = data;
+        (p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr; ) {
+      p++;
+      starts.push_back(base + (p - data));
+    }
+
+  }
+
+
+  // push the line start for every set bit of a block mask.
+  static inline void push_mask(uint64_t mask, uint64_t offset, std::vector<uint64_t>& starts) {
+    while(mask) {
+      starts.push_back(offset + __builtin_ctzll(mask) + 1);
+      mask &= mask - 1;
+    }
+  }
+
+
+#ifdef LINE_INDEX_X86
+
+  /**
+     Both vector kernels work on 64 byte blocks, compare
+     every byte against '\n' and fold the results into a 64
+     bit mask. Most blocks of text hold at most one or two
+     newlines so the common case is a test and a branch.
+   */
+
+  __attribute__((target("sse2")))
+  static void find_newlines_sse2(const char* data, size_t len, uint64_t base, std::vector<uint64_t>& starts) {
+
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = 0;
+
+    for(; i + 64 <= len; i += 64) {
+      auto p = reinterpret_cast<const __m128i*>(data + i);
+
+      uint64_t m0 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 0), nl));
+      uint64_t m1 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 1), nl));
+      uint64_t m2 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), nl));
+      uint64_t m3 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 3), nl));
+
+      uint64_t mask = m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+
+      if(mask)
+        push_mask(mask, base + i, starts);
+    }
+
+    find_newlines_scalar(data + i, len - i, base + i, starts);
+
+  }
+
+
+  __attribute__((target("avx2")))
+  static void find_newlines_avx2(const char* data, size_t len, uint64_t base, std::vector<uint64_t>& starts) {
+
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = 0;
+
+    for(; i + 64 <= len; i += 64) {
+      auto p = reinterpret_cast<const __m256i*>(data + i);
+
+      uint64_t lo = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(p + 0), nl)));
+      uint64_t hi = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(p + 1), nl)));
+
+      uint64_t mask = lo | (hi << 32);
+
+      if(mask)
+        push_mask(mask, base + i, starts);
+    }
+
+    find_newlines_scalar(data + i, len - i, base + i, starts);
+
+  }
+
+#endif
+
+
+  bool scan_kernel_supported(Scan_Kernel k) {
+    switch(k) {
+    case Scan_Kernel::scalar:
+      return true;
+#ifdef LINE_INDEX_X86
+    case Scan_Kernel::sse2:
+      return __builtin_cpu_supports("sse2");
+    case Scan_Kernel::avx2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+    }
+  }
+
+
+  Scan_Kernel best_scan_kernel() {
+    static const Scan_Kernel best = []() {
+      if(scan_kernel_supported(Scan_Kernel::avx2))
+        return Scan_Kernel::avx2;
+      if(scan_kernel_supported(Scan_Kernel::sse2))
+        return Scan_Kernel::sse2;
+      return Scan_Kernel::scalar;
+    }();
+
+    return best;
+  }
+
+
+  const char* scan_kernel_name(Scan_Kernel k) {
+    switch(k) {
+    case Scan_Kernel::sse2:
+      return "sse2";
+    case Scan_Kernel::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+    }
+  }
+
+
+  void find_newlines(Scan_Kernel k, const char* data, size_t len, uint64_t base, std::vector<uint64_t>& starts) {
+    switch(k) {
+#ifdef LINE_INDEX_X86
+    case Scan_Kernel::sse2:
+      find_newlines_sse2(data, len, base, starts);
+      return;
+    case Scan_Kernel::avx2:
+      find_newlines_avx2(data, len, base, starts);
+      return;
+#endif
+    default:
+      find_newlines_scalar(data, len, base, starts);
+      return;
+    }
+  }
+
+
+  void find_newlines(const char* data, size_t len, uint64_t base, std::vector<uint64_t>& starts) {
+    find_newlines(best_scan_kernel(), data, len, base, starts);
+  }
+
+
+
+  Line_Indexer::Line_Indexer(const char* data, size_t size, size_t chunk_size, unsigned threads) {
+
+    this->data = data;
+
+    for(size_t offset = 0; offset < size; offset += chunk_size) {
+      this->chunks.push_back({offset, std::min(chunk_size, size - offset), {}});
+    }
+
+    if(threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    threads = std::min<size_t>(threads, this->chunks.size());
+
+    for(unsigned i = 0; i < threads; i++) {
+      this->workers.emplace_back(&Line_Indexer::work, this);
+    }
+
+  }
+
+
+  Line_Indexer::~Line_Indexer() {
+
+    this->cancelled = true;
+
+    for(auto& t : this->workers) {
+      t.join();
+    }
+
+  }
+
+
+  void Line_Indexer::work() {
+
+    // chunks are claimed in order so the front of the
+    // file, which is needed first, is finished first.
+    for(size_t i; !this->cancelled && (i = this->next_chunk++) < this->chunks.size(); ) {
+
+      auto& c = this->chunks[i];
+
+      std::vector<uint64_t> starts;
+      find_newlines(this->data + c.offset, c.len, c.offset, starts);
+
+      {
+        std::lock_guard<std::mutex> g(this->lock);
+        c.starts = std::move(starts);
+        c.ready = true;
+      }
+
+      this->chunk_ready.notify_all();
+    }
+
+  }
+
+
+  bool Line_Indexer::collect(std::vector<uint64_t>& starts, bool wait) {
+
+    std::unique_lock<std::mutex> g(this->lock);
+
+    if(wait && !this->done()) {
+      this->chunk_ready.wait(g, [this]() {
+        return this->chunks[this->collected].ready;
+      });
+    }
+
+    while(!this->done() && this->chunks[this->collected].ready) {
+      auto& c = this->chunks[this->collected];
+      starts.insert(starts.end(), c.starts.begin(), c.starts.end());
+
+      std::vector<uint64_t>().swap(c.starts);
+      this->collected++;
+    }
+
+    return this->done();
+
+  }
+
+}
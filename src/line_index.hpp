@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace files {
+
+  /**
+
+     Newline scanning used to index where lines start.
+
+     There is a scalar kernel and vectorised SSE2 and AVX2
+     kernels. The widest one the CPU supports is picked at
+     runtime, so a binary built for an older host still uses
+     AVX2 where it is available, and the other way round.
+
+   */
+
+  enum class Scan_Kernel {
+    scalar,
+    sse2,
+    avx2,
+  };
+
+
+  bool scan_kernel_supported(Scan_Kernel k);
+  Scan_Kernel best_scan_kernel();
+  const char* scan_kernel_name(Scan_Kernel k);
+
+
+  /**
+     find_newlines
+
+     for every '\n' at offset i of data[0, len) append
+     base + i + 1 (the start of the following line) to starts.
+   */
+  void find_newlines(const char* data, size_t len, uint64_t base, std::vector<uint64_t>& starts);
+  void find_newlines(Scan_Kernel k, const char* data, size_t len, uint64_t base, std::vector<uint64_t>& starts);
+
+
+
+  /**
+
+     Line_Indexer
+
+     Indexes a large buffer in the background. The buffer is
+     split into fixed size chunks which a pool of threads
+     scan with find_newlines, each into its own vector.
+
+     Chunks are handed back strictly in file order by
+     collect(). The first line number of a chunk is the
+     running sum of the counts before it, so stitching is
+     just appending. The caller can show the top of the
+     file while the rest is still being scanned.
+
+     The buffer must outlive the indexer.
+
+   */
+  class Line_Indexer {
+  private:
+    struct Chunk {
+      size_t offset;
+      size_t len;
+      std::vector<uint64_t> starts;
+      bool ready = false;
+    };
+
+    const char* data;
+    std::vector<Chunk> chunks;
+    size_t collected = 0; // chunks handed back so far
+
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<bool> cancelled{false};
+    std::mutex lock;
+    std::condition_variable chunk_ready;
+    std::vector<std::thread> workers;
+
+    void work();
+
+  public:
+    Line_Indexer(const char* data, size_t size, size_t chunk_size = 8 << 20, unsigned threads = 0);
+    ~Line_Indexer();
+
+    Line_Indexer(const Line_Indexer&) = delete;
+    Line_Indexer& operator=(const Line_Indexer&) = delete;
+
+    /**
+       collect
+
+       append the starts of every finished chunk, in order, to
+       `starts`. With wait set it blocks for at least one more
+       chunk. Returns true once the whole buffer is indexed.
+     */
+    bool collect(std::vector<uint64_t>& starts, bool wait = false);
+
+    bool done() const {
+      return this->collected == this->chunks.size();
+    }
+  };
+
+}
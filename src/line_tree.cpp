@@ -0,0 +1,448 @@
+#include "line_tree.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace files {
+
+
+  void Line_Tree::destroy(Node* t) {
+    if(t == nullptr)
+      return;
+
+    this->destroy(t->left);
+    this->destroy(t->right);
+
+    if(t->line != nullptr)
+      this->arena->destroy(t->line);
+
+    this->nodes.destroy(t);
+  }
+
+
+  void Line_Tree::attach(const char* data, size_t size, const std::vector<uint64_t>* index) {
+    this->data = data;
+    this->data_size = size;
+    this->index = index;
+  }
+
+
+  uint32_t Line_Tree::random() {
+    // xorshift32, only needs to be cheap and spread out.
+    this->seed ^= this->seed << 13;
+    this->seed ^= this->seed >> 17;
+    this->seed ^= this->seed << 5;
+    return this->seed;
+  }
+
+
+  Line_Tree::Node* Line_Tree::new_node() {
+    auto t = this->nodes.make();
+    t->priority = this->random();
+    return t;
+  }
+
+
+  size_t Line_Tree::run_bytes(Node* t) {
+    auto span = this->run_span(t);
+    return span.second - span.first;
+  }
+
+
+  std::pair<uint64_t, uint64_t> Line_Tree::run_span(Node* t) {
+    const auto& idx = *this->index;
+    const uint64_t begin = idx[t->first];
+    const uint64_t end = t->first + t->count < idx.size() ? idx[t->first + t->count] : this->data_size;
+    return {begin, end};
+  }
+
+
+  void Line_Tree::pull(Node* t) {
+
+    if(t->line != nullptr)
+      t->bytes = t->line->length() + 1;
+
+    t->sub_lines = t->count;
+    t->sub_bytes = t->bytes;
+
+    if(t->left) {
+      t->sub_lines += t->left->sub_lines;
+      t->sub_bytes += t->left->sub_bytes;
+    }
+
+    if(t->right) {
+      t->sub_lines += t->right->sub_lines;
+      t->sub_bytes += t->right->sub_bytes;
+    }
+
+  }
+
+
+  Line* Line_Tree::map(size_t source_line) {
+
+    const auto& idx = *this->index;
+    const auto start = idx[source_line];
+    size_t end;
+
+    if(source_line + 1 < idx.size()) {
+      end = idx[source_line + 1] - 1;
+    } else {
+      // last line indexed so far, it runs to the next newline.
+      auto nl = static_cast<const char*>(memchr(this->data + start, '\n', this->data_size - start));
+      end = nl ? nl - this->data : this->data_size;
+    }
+
+    return this->arena->mapped(this->data + start, end - start);
+
+  }
+
+
+  /**
+     split
+
+     l gets the first k lines of t and r the rest. If k
+     lands inside a run the run is cut in two.
+   */
+  void Line_Tree::split(Node* t, size_t k, Node*& l, Node*& r) {
+
+    if(t == nullptr) {
+      l = r = nullptr;
+      return;
+    }
+
+    const size_t left = t->left ? t->left->sub_lines : 0;
+
+    if(k <= left) {
+      this->split(t->left, k, l, t->left);
+      r = t;
+      this->pull(t);
+
+    } else if(k >= left + t->count) {
+      this->split(t->right, k - left - t->count, t->right, r);
+      l = t;
+      this->pull(t);
+
+    } else {
+      const size_t cut = k - left;
+
+      auto tail = this->new_node();
+      tail->first = t->first + cut;
+      tail->count = t->count - cut;
+      tail->bytes = this->run_bytes(tail);
+      this->pull(tail);
+
+      t->count = cut;
+      t->bytes = this->run_bytes(t);
+
+      r = this->merge(tail, t->right);
+      t->right = nullptr;
+      this->pull(t);
+      l = t;
+    }
+
+  }
+
+
+  Line_Tree::Node* Line_Tree::merge(Node* a, Node* b) {
+
+    if(a == nullptr)
+      return b;
+    if(b == nullptr)
+      return a;
+
+    if(a->priority > b->priority) {
+      a->right = this->merge(a->right, b);
+      this->pull(a);
+      return a;
+    }
+
+    b->left = this->merge(a, b->left);
+    this->pull(b);
+    return b;
+
+  }
+
+
+  Line* Line_Tree::at(size_t n) {
+
+    if(n >= this->size())
+      return nullptr;
+
+    // walk down first, the line is usually already there.
+    size_t k = n;
+    for(auto t = this->root; t != nullptr; ) {
+      const size_t left = t->left ? t->left->sub_lines : 0;
+
+      if(k < left) {
+        t = t->left;
+      } else if(k < left + t->count) {
+        if(t->line != nullptr)
+          return t->line;
+        break;
+      } else {
+        k -= left + t->count;
+        t = t->right;
+      }
+    }
+
+    // inside a run, cut the line out and map it.
+    Node *a, *b, *m, *c;
+    this->split(this->root, n, a, b);
+    this->split(b, 1, m, c);
+
+    m->line = this->map(m->first);
+    this->pull(m);
+
+    this->root = this->merge(this->merge(a, m), c);
+
+    return m->line;
+
+  }
+
+
+  /**
+     expand
+
+     at() for a whole range: the lines come out of their runs
+     with one split and merge for the lot rather than two of
+     each per line. Lines already out are kept as they are.
+   */
+  void Line_Tree::expand(size_t n, size_t count) {
+
+    if(n >= this->size() || count == 0)
+      return;
+
+    Node *a, *b, *m, *c;
+    this->split(this->root, n, a, b);
+    this->split(b, count, m, c);
+
+    Node* block = nullptr;
+    auto add = [&](Node* t) {
+      if(t->line != nullptr) {
+        t->left = t->right = nullptr;
+        this->pull(t);
+        block = this->merge(block, t);
+        return;
+      }
+
+      for(size_t i = 0; i < t->count; i++) {
+        auto l = this->new_node();
+        l->line = this->map(t->first + i);
+        this->pull(l);
+        block = this->merge(block, l);
+      }
+      this->nodes.destroy(t);
+    };
+
+    // nodes are taken apart as they are visited, collect first.
+    std::vector<Node*> in_order;
+    auto collect = [&](Node* t) { in_order.push_back(t); };
+    walk(m, collect);
+    for(auto t : in_order)
+      add(t);
+
+    this->root = this->merge(this->merge(a, block), c);
+
+  }
+
+
+  void Line_Tree::insert(size_t n, Line* l) {
+
+    auto t = this->new_node();
+    t->line = l;
+    this->pull(t);
+
+    Node *a, *b;
+    this->split(this->root, n, a, b);
+    this->root = this->merge(this->merge(a, t), b);
+
+  }
+
+
+  void Line_Tree::insert(size_t n, Line* const* ls, size_t count) {
+
+    if(count == 0)
+      return;
+
+    // build the new lines into their own treap first, then
+    // it costs one split and two merges however many there are.
+    Node* block = nullptr;
+    for(size_t i = 0; i < count; i++) {
+      auto t = this->new_node();
+      t->line = ls[i];
+      this->pull(t);
+      block = this->merge(block, t);
+    }
+
+    Node *a, *b;
+    this->split(this->root, n, a, b);
+    this->root = this->merge(this->merge(a, block), b);
+
+  }
+
+
+  void Line_Tree::erase(size_t n) {
+    this->erase(n, 1);
+  }
+
+
+  void Line_Tree::erase(size_t n, size_t count) {
+
+    if(n >= this->size() || count == 0)
+      return;
+
+    Node *a, *b, *m, *c;
+    this->split(this->root, n, a, b);
+    this->split(b, count, m, c);
+
+    this->destroy(m);
+
+    this->root = this->merge(a, c);
+
+  }
+
+
+  void Line_Tree::resized(Node* t, size_t n) {
+
+    const size_t left = t->left ? t->left->sub_lines : 0;
+
+    if(n < left) {
+      this->resized(t->left, n);
+    } else if(n >= left + t->count) {
+      this->resized(t->right, n - left - t->count);
+    }
+
+    this->pull(t);
+
+  }
+
+
+  void Line_Tree::resized(size_t n) {
+    if(n < this->size())
+      this->resized(this->root, n);
+  }
+
+
+  void Line_Tree::refresh(Node* t) {
+    if(t == nullptr)
+      return;
+
+    this->refresh(t->left);
+    this->refresh(t->right);
+    this->pull(t);
+  }
+
+
+  void Line_Tree::refresh() {
+    this->refresh(this->root);
+  }
+
+
+  void Line_Tree::extend_tail(Node* t, size_t count) {
+
+    if(t->right) {
+      this->extend_tail(t->right, count);
+    } else {
+      t->count += count;
+      t->bytes = this->run_bytes(t);
+    }
+
+    this->pull(t);
+
+  }
+
+
+  void Line_Tree::append_run(size_t first, size_t count) {
+
+    if(count == 0)
+      return;
+
+    auto last = this->root;
+    while(last && last->right)
+      last = last->right;
+
+    // lines indexed in the background carry on the last run.
+    if(last && last->line == nullptr && last->first + last->count == first) {
+      this->extend_tail(this->root, count);
+      return;
+    }
+
+    auto t = this->new_node();
+    t->first = first;
+    t->count = count;
+    t->bytes = this->run_bytes(t);
+    this->pull(t);
+
+    this->root = this->merge(this->root, t);
+
+  }
+
+
+  size_t Line_Tree::line_of_offset(uint64_t offset) {
+
+    size_t line = 0;
+
+    for(auto t = this->root; t != nullptr; ) {
+      const size_t left_bytes = t->left ? t->left->sub_bytes : 0;
+
+      if(offset < left_bytes) {
+        t = t->left;
+        continue;
+      }
+
+      offset -= left_bytes;
+      line += t->left ? t->left->sub_lines : 0;
+
+      if(offset < t->bytes) {
+        if(t->line != nullptr)
+          return line;
+
+        // find the line inside the run from the index.
+        const auto& idx = *this->index;
+        auto first = idx.begin() + t->first;
+        auto in_run = std::upper_bound(first, first + t->count, *first + offset) - first - 1;
+        return line + in_run;
+      }
+
+      offset -= t->bytes;
+      line += t->count;
+      t = t->right;
+    }
+
+    // past the end, clamp to the last line.
+    return this->size() ? this->size() - 1 : 0;
+
+  }
+
+
+  uint64_t Line_Tree::offset_of_line(size_t n) {
+
+    uint64_t offset = 0;
+
+    for(auto t = this->root; t != nullptr; ) {
+      const size_t left = t->left ? t->left->sub_lines : 0;
+
+      if(n < left) {
+        t = t->left;
+        continue;
+      }
+
+      offset += t->left ? t->left->sub_bytes : 0;
+      n -= left;
+
+      if(n < t->count) {
+        if(t->line == nullptr)
+          offset += (*this->index)[t->first + n] - (*this->index)[t->first];
+        return offset;
+      }
+
+      offset += t->bytes;
+      n -= t->count;
+      t = t->right;
+    }
+
+    return offset;
+
+  }
+
+}
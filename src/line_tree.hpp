@@ -0,0 +1,162 @@
+#pragma once
+
+#include "arena.hpp"
+#include "line.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace files {
+
+  /**
+
+     Line_Tree
+
+     Every line of a file, ordered by line number, in a
+     treap keyed on position. Each node keeps the line and
+     byte counts of its subtree so finding a line by number
+     or by byte offset, inserting and erasing are all
+     O(log n) expected.
+
+     A node is either a Line or a run of consecutive,
+     untouched lines of the source file (first .. first + count
+     in the line index). Runs are only broken up when a line
+     inside them is asked for, so a file that has just been
+     opened is a single node.
+
+       [run 0..41] [Line 42] [run 43..9999]
+                      ^ at(42)
+
+   */
+  class Line_Tree {
+  public:
+    struct Node {
+      Node* left = nullptr;
+      Node* right = nullptr;
+      uint32_t priority;
+
+      Line* line = nullptr; // a Line, or
+      size_t first = 0;     // a run of source lines [first, first + count)
+      size_t count = 1;
+      size_t bytes = 0;     // bytes in this node, newlines included
+
+      size_t sub_lines = 0; // totals for this subtree
+      size_t sub_bytes = 0;
+    };
+
+  private:
+    Node* root = nullptr;
+    uint32_t seed = 0x9e3779b9;
+
+    buffers::Slab<Node> nodes;
+    Line_Arena* arena; // owns the Lines
+
+    const char* data = nullptr;
+    size_t data_size = 0;
+    const std::vector<uint64_t>* index = nullptr;
+
+    uint32_t random();
+    Node* new_node();
+    void pull(Node* t);
+    size_t run_bytes(Node* t);
+    Line* map(size_t source_line);
+
+    void split(Node* t, size_t k, Node*& l, Node*& r);
+    Node* merge(Node* a, Node* b);
+    void resized(Node* t, size_t n);
+    void refresh(Node* t);
+    void extend_tail(Node* t, size_t count);
+    void destroy(Node* t);
+
+    template<typename F>
+    static void walk(Node* t, F& f) {
+      if(t == nullptr)
+        return;
+      walk(t->left, f);
+      f(t);
+      walk(t->right, f);
+    }
+
+    template<typename F>
+    static bool visit_forward(Node* t, uint64_t base, uint64_t from, F& f) {
+      if(t == nullptr)
+        return false;
+      const uint64_t at = base + (t->left ? t->left->sub_bytes : 0);
+      if(from < at && visit_forward(t->left, base, from, f))
+        return true;
+      if(from < at + t->bytes && f(t, at))
+        return true;
+      return visit_forward(t->right, at + t->bytes, from, f);
+    }
+
+    template<typename F>
+    static bool visit_backward(Node* t, uint64_t base, uint64_t from, F& f) {
+      if(t == nullptr)
+        return false;
+      const uint64_t at = base + (t->left ? t->left->sub_bytes : 0);
+      if(at + t->bytes < from && visit_backward(t->right, at + t->bytes, from, f))
+        return true;
+      if(at < from && f(t, at))
+        return true;
+      return visit_backward(t->left, base, from, f);
+    }
+
+  public:
+    // nodes and lines are freed in bulk with their slabs.
+    Line_Tree(Line_Arena* arena) : arena(arena) {}
+    ~Line_Tree() = default;
+
+    Line_Tree(const Line_Tree&) = delete;
+    Line_Tree& operator=(const Line_Tree&) = delete;
+
+    // the source text runs are read from, `index` holds the line starts.
+    void attach(const char* data, size_t size, const std::vector<uint64_t>* index);
+
+    inline size_t size() {
+      return this->root ? this->root->sub_lines : 0;
+    }
+
+    inline size_t bytes() {
+      return this->root ? this->root->sub_bytes : 0;
+    }
+
+    Line* at(size_t n);                  // line n, mapped out of a run if needed
+    void insert(size_t n, Line* l);      // l (from the arena) becomes line n
+    void insert(size_t n, Line* const* ls, size_t count); // ls become lines n..n+count-1
+    void erase(size_t n);                // remove and delete line n
+    void erase(size_t n, size_t count);  // lines n..n+count-1
+    void resized(size_t n);              // line n changed length
+    void expand(size_t n, size_t count); // map lines n..n+count-1 out of their runs at once
+    void refresh();                      // recount after lines changed length without resized()
+    void append_run(size_t first, size_t count);
+
+    size_t line_of_offset(uint64_t offset);
+    uint64_t offset_of_line(size_t n);
+
+    std::pair<uint64_t, uint64_t> run_span(Node* t); // source bytes covered by a run
+
+    // visit every node in order
+    template<typename F>
+    void for_each(F f) {
+      walk(this->root, f);
+    }
+
+    /**
+       visit_from
+
+       f(node, offset of the node) for the nodes from the one
+       holding byte `from` onwards, or for those starting
+       before it going backwards, until f returns true.
+       Subtrees entirely on the wrong side are never entered.
+     */
+    template<typename F>
+    bool visit_from(uint64_t from, bool forward, F f) {
+      return forward ? visit_forward(this->root, 0, from, f)
+        : visit_backward(this->root, 0, from, f);
+    }
+
+  };
+
+}
@@ -3,22 +3,65 @@
 #include "editor.hpp"
 #include "file.hpp"
 #include "gap_buffer.hpp"
+#include "replay.hpp"
 #include "terminal.hpp"
 
 
+/**
+   alter [--replay script | --record script] [--trace out.json] file
+
+   --record appends every read of the terminal to script,
+   --replay feeds a script back with no terminal at all and
+   prints input to paint latencies when it runs out (see
+   Replay_Backend). --trace writes where each frame's time
+   went as a Chrome trace on exit (see Diagnostics).
+ */
 int main(int argc, char **argv) {
 
   using std::cout, std::endl;
 
+  const char* replay = nullptr;
+  const char* record = nullptr;
+  const char* trace = nullptr;
+
+  int arg = 1;
+  for(; arg + 1 < argc; arg += 2) {
+    if(std::string(argv[arg]) == "--replay")
+      replay = argv[arg + 1];
+    else if(std::string(argv[arg]) == "--record")
+      record = argv[arg + 1];
+    else if(std::string(argv[arg]) == "--trace")
+      trace = argv[arg + 1];
+    else
+      break;
+  }
+
+  if(arg >= argc)
+    return 1;
+
+  const char* path = argv[arg];
+
+  static terminal::Replay_Backend replayer;
+
+  if(replay != nullptr) {
+    if(!replayer.load(replay)) {
+      std::cerr << "Can't read replay script " << replay << endl;
+      return 1;
+    }
+    terminal::set_backend(&replayer);
+  } else {
+    cout << "[EDITOR] Version 0.0.0d" << endl;
+  }
 
-  cout << "[EDITOR] Version 0.0.0d" << endl;
+  if(record != nullptr)
+    terminal::record_input(record);
   
   editor::TUI_Editor *te = new editor::TUI_Editor();  
 
-  if(argc < 2)
-    return 1;
-  
-  te->open_file(argv[1]);
+  if(trace != nullptr)
+    te->diag.trace_to(trace);
+
+  te->open_file(path);
 
   
   // down
@@ -55,25 +98,51 @@ int main(int argc, char **argv) {
 
 
   // ALT codes
-  te->keymap[27] = [te]() {
-
-    char cmd = terminal::get_input()();
-    if(cmd == 'f') {
-      auto filename = te->get_user_input("Open: ");          
-      te->open_file(filename);
-      
-    } else if (cmd == 's') {
-      auto filename = te->get_user_input("Save as: ");
-      if(filename.length() > 1)
-        te->save(filename);
-      
-    } else if (cmd <= 57 && cmd >= 49) { // numbers 1 -> 9
-      te->switch_buffer(cmd - 48);
-    }
-    
-    
+  te->alt_keymap['f'] = [te]() {
+    auto filename = te->get_user_input("Open: ");          
+    te->open_file(filename);
+  };
+
+  te->alt_keymap['s'] = [te]() {
+    auto filename = te->get_user_input("Save as: ");
+    if(filename.length() > 1)
+      te->put_status_line(te->save(filename) ? "Saved" : "Save failed");
+  };
+
+  // alt-w == regex search, alt-r == regex replace all
+  te->alt_keymap['w'] = [te]() {
+    te->search(true, true);
+  };
+
+  te->alt_keymap['r'] = [te]() {
+    te->replace_all();
+  };
+
+  // alt-l == line numbers on / off, alt-z == wrapping on / off
+  te->alt_keymap['l'] = [te]() {
+    auto mode = terminal::get_render_mode();
+    mode.numbers = !mode.numbers;
+    te->set_render_mode(mode);
+  };
+
+  te->alt_keymap['z'] = [te]() {
+    auto mode = terminal::get_render_mode();
+    mode.wrap = !mode.wrap;
+    te->set_render_mode(mode);
   };
 
+  // alt-d == frame timings on the status line
+  te->alt_keymap['d'] = [te]() {
+    te->diag.overlay = !te->diag.overlay;
+  };
+
+  // numbers 1 -> 9
+  for(char n = '1'; n <= '9'; n++) {
+    te->alt_keymap[n] = [te, n]() {
+      te->switch_buffer(n - '0');
+    };
+  }
+
 
   // ctrl-e == end
   te->keymap[5] = [te]() {
@@ -87,16 +156,51 @@ int main(int argc, char **argv) {
   };
 
 
+  // ctrl-z == undo, ctrl-y == redo
+  te->keymap[26] = [te]() {
+    te->undo();
+  };
+
+  te->keymap[25] = [te]() {
+    te->redo();
+  };
+
+
+  // ctrl-w == search, ctrl-r == search backward
+  te->keymap[23] = [te]() {
+    te->search(true);
+  };
+
+  te->keymap[18] = [te]() {
+    te->search(false);
+  };
+
+
+  // ctrl-g == go to line, alt-g == go to byte offset
+  te->keymap[7] = [te]() {
+    te->go_to(false);
+  };
+
+  te->alt_keymap['g'] = [te]() {
+    te->go_to(true);
+  };
+
+
   // ctrl-s == save
-  te->keymap[19] = [te, argv]() {
-    te->save(argv[1]);
-    te->put_status_line("Saved");
+  te->keymap[19] = [te, path]() {
+    te->put_status_line(te->save(path) ? "Saved" : "Save failed");
   };
 
 
 
   te->run();
 
+  if(!te->diag.dump_trace())
+    std::cerr << "Can't write trace " << trace << endl;
+
+  if(replay != nullptr)
+    replayer.report(stdout);
+
 
 }
 
@@ -0,0 +1,95 @@
+#include "mapped_file.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace files {
+
+
+  Mapped_File::~Mapped_File() {
+    this->close();
+  }
+
+
+  bool Mapped_File::open(const std::string& path) {
+
+    this->close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd == -1) {
+      return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == -1) {
+      ::close(fd);
+      return false;
+    }
+
+    if(S_ISREG(st.st_mode) && st.st_size > 0) {
+
+      void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if(p != MAP_FAILED) {
+        // lines are read front to back.
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+        this->fd = fd;
+        this->data = static_cast<const char*>(p);
+        this->size = st.st_size;
+        this->mapped = true;
+        return true;
+      }
+    }
+
+
+    // can't map it, read it in instead.
+    size_t capacity = 4096;
+    char* b = new char[capacity];
+    size_t len = 0;
+
+    for(ssize_t n; (n = read(fd, b + len, capacity - len)) > 0; ) {
+      len += n;
+
+      if(len == capacity) {
+        char* nb = new char[capacity * 2];
+        memcpy(nb, b, len);
+        delete[] b;
+        b = nb;
+        capacity *= 2;
+      }
+    }
+
+    ::close(fd);
+
+    this->data = b;
+    this->size = len;
+    this->mapped = false;
+    return true;
+
+  }
+
+
+  void Mapped_File::close() {
+
+    if(this->data == nullptr)
+      return;
+
+    if(this->mapped) {
+      munmap(const_cast<char*>(this->data), this->size);
+      ::close(this->fd);
+      this->fd = -1;
+    } else {
+      delete[] this->data;
+    }
+
+    this->data = nullptr;
+    this->size = 0;
+    this->mapped = false;
+
+  }
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <sys/types.h>
+
+namespace files {
+
+  /**
+
+     Mapped_File
+
+     Read only view of a file on disk. Regular files are
+     mmap'd so nothing is read until a page is touched,
+     anything that can't be mapped (pipes, /dev/stdin ...)
+     is read into a heap block instead.
+
+     The view stays valid for the lifetime of the object,
+     even if the file is replaced on disk.
+
+   */
+  class Mapped_File {
+  private:
+    bool mapped = false;
+
+  public:
+    const char* data = nullptr;
+    size_t size = 0;
+    int fd = -1; // kept open while mapped, saves copy unchanged spans from it
+
+    Mapped_File() = default;
+    ~Mapped_File();
+
+    Mapped_File(const Mapped_File&) = delete;
+    Mapped_File& operator=(const Mapped_File&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+  };
+
+}
@@ -0,0 +1,653 @@
+#include "regex.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace files {
+
+
+  int Regex::node(Node n) {
+    this->nodes.push_back(n);
+    return this->nodes.size() - 1;
+  }
+
+
+  bool Regex::compile(std::string_view pattern) {
+
+    this->program.clear();
+    this->classes.clear();
+    this->nodes.clear();
+    this->error.clear();
+    this->pattern = pattern;
+    this->pos = 0;
+
+    const int root = this->parse_alt();
+
+    if(this->error.empty() && this->pos < pattern.size())
+      this->error = "unmatched )";
+
+    if(!this->error.empty())
+      return false;
+
+    this->emit(root);
+    this->program.push_back({inst_t::MATCH});
+    this->nodes.clear();
+
+    return true;
+
+  }
+
+
+  // alt := cat ('|' cat)*
+  int Regex::parse_alt() {
+
+    int left = this->parse_cat();
+
+    while(this->pos < this->pattern.size() && this->pattern[this->pos] == '|') {
+      this->pos++;
+      const int right = this->parse_cat();
+      left = this->node({Node::ALT, 0, left, right});
+    }
+
+    return left;
+
+  }
+
+
+  // cat := repeat*
+  int Regex::parse_cat() {
+
+    int left = this->node({Node::EMPTY});
+
+    while(this->pos < this->pattern.size() && this->error.empty()) {
+      const char c = this->pattern[this->pos];
+      if(c == '|' || c == ')')
+        break;
+
+      const int right = this->parse_repeat();
+      left = this->node({Node::CAT, 0, left, right});
+    }
+
+    return left;
+
+  }
+
+
+  // repeat := atom ('*' | '+' | '?')*
+  int Regex::parse_repeat() {
+
+    int n = this->parse_atom();
+
+    while(this->pos < this->pattern.size()) {
+      const char c = this->pattern[this->pos];
+
+      if(c == '*')
+        n = this->node({Node::STAR, 0, n});
+      else if(c == '+')
+        n = this->node({Node::PLUS, 0, n});
+      else if(c == '?')
+        n = this->node({Node::QUEST, 0, n});
+      else
+        break;
+
+      this->pos++;
+    }
+
+    return n;
+
+  }
+
+
+  int Regex::parse_atom() {
+
+    const char c = this->pattern[this->pos++];
+    std::bitset<256> set;
+
+    switch(c) {
+
+    case '(': {
+      const int n = this->parse_alt();
+      if(this->pos >= this->pattern.size() || this->pattern[this->pos] != ')') {
+        this->error = "missing )";
+        return n;
+      }
+      this->pos++;
+      return n;
+    }
+
+    case '*': case '+': case '?':
+      this->error = "nothing to repeat";
+      return this->node({Node::EMPTY});
+
+    case '^':
+      return this->node({Node::BOL});
+
+    case '$':
+      return this->node({Node::EOL});
+
+    case '.':
+      set.set();
+      set.reset('\n');
+      break;
+
+    case '[':
+      if(!this->parse_class(set))
+        return this->node({Node::EMPTY});
+      break;
+
+    case '\\':
+      if(!this->parse_escape(set))
+        return this->node({Node::EMPTY});
+      break;
+
+    default:
+      set.set(static_cast<unsigned char>(c));
+    }
+
+    this->classes.push_back(set);
+    return this->node({Node::CLASS, (int) this->classes.size() - 1});
+
+  }
+
+
+  bool Regex::parse_escape(std::bitset<256>& set) {
+
+    if(this->pos >= this->pattern.size()) {
+      this->error = "trailing \\";
+      return false;
+    }
+
+    const char c = this->pattern[this->pos++];
+
+    auto fill = [&](int (*is)(int), bool negate) {
+      for(int i = 0; i < 256; i++)
+        if((is(i) != 0) != negate)
+          set.set(i);
+    };
+
+    switch(c) {
+    case 'd': fill(isdigit, false); break;
+    case 'D': fill(isdigit, true); break;
+    case 's': fill(isspace, false); break;
+    case 'S': fill(isspace, true); break;
+    case 'w': fill(isalnum, false); set.set('_'); break;
+    case 'W': fill(isalnum, true); set.reset('_'); break;
+    case 't': set.set('\t'); break;
+    case 'n': set.set('\n'); break;
+    default:  set.set(static_cast<unsigned char>(c));
+    }
+
+    return true;
+
+  }
+
+
+  // [abc] [a-z] [^...], the opening [ is already read.
+  bool Regex::parse_class(std::bitset<256>& set) {
+
+    bool negate = false;
+    if(this->pos < this->pattern.size() && this->pattern[this->pos] == '^') {
+      negate = true;
+      this->pos++;
+    }
+
+    bool first = true;
+
+    while(true) {
+
+      if(this->pos >= this->pattern.size()) {
+        this->error = "missing ]";
+        return false;
+      }
+
+      char c = this->pattern[this->pos++];
+
+      // a ] straight after [ or [^ is a literal
+      if(c == ']' && !first)
+        break;
+      first = false;
+
+      if(c == '\\') {
+        if(!this->parse_escape(set))
+          return false;
+        continue;
+      }
+
+      unsigned char lo = c, hi = c;
+
+      if(this->pos + 1 < this->pattern.size() && this->pattern[this->pos] == '-'
+         && this->pattern[this->pos + 1] != ']') {
+        hi = this->pattern[this->pos + 1];
+        this->pos += 2;
+      }
+
+      for(int i = lo; i <= hi; i++)
+        set.set(i);
+    }
+
+    if(negate) {
+      set.flip();
+      set.reset('\n');
+    }
+
+    return true;
+
+  }
+
+
+  /**
+     emit
+
+     Thompson's construction, with e the code for the child:
+
+       a|b   split L1 L2; L1: a; jmp L3; L2: b; L3:
+       e*    L1: split L2 L3; L2: e; jmp L1; L3:
+       e+    L1: e; split L1 L2; L2:
+       e?    split L1 L2; L1: e; L2:
+   */
+  void Regex::emit(int n) {
+
+    const Node nd = this->nodes[n];
+    auto& p = this->program;
+
+    switch(nd.type) {
+
+    case Node::CLASS:
+      p.push_back({inst_t::CLASS, nd.cls});
+      break;
+
+    case Node::CAT:
+      this->emit(nd.left);
+      this->emit(nd.right);
+      break;
+
+    case Node::ALT: {
+      const int split = p.size();
+      p.push_back({inst_t::SPLIT});
+      p[split].x = p.size();
+      this->emit(nd.left);
+      const int jmp = p.size();
+      p.push_back({inst_t::JMP});
+      p[split].y = p.size();
+      this->emit(nd.right);
+      p[jmp].x = p.size();
+      break;
+    }
+
+    case Node::STAR: {
+      const int split = p.size();
+      p.push_back({inst_t::SPLIT});
+      p[split].x = p.size();
+      this->emit(nd.left);
+      p.push_back({inst_t::JMP, split});
+      p[split].y = p.size();
+      break;
+    }
+
+    case Node::PLUS: {
+      const int start = p.size();
+      this->emit(nd.left);
+      p.push_back({inst_t::SPLIT, start});
+      p.back().y = p.size();
+      break;
+    }
+
+    case Node::QUEST: {
+      const int split = p.size();
+      p.push_back({inst_t::SPLIT});
+      p[split].x = p.size();
+      this->emit(nd.left);
+      p[split].y = p.size();
+      break;
+    }
+
+    case Node::BOL:
+      p.push_back({inst_t::BOL});
+      break;
+
+    case Node::EOL:
+      p.push_back({inst_t::EOL});
+      break;
+
+    case Node::EMPTY:
+      break;
+    }
+
+  }
+
+
+
+  Matcher::Matcher(const Regex* re) : re(re) {}
+
+
+  /**
+     closure
+
+     every instruction reachable from pcs without reading a
+     byte. Only the ones that matter to a state are kept:
+     CLASS (wants a byte), EOL (waits for the line end) and
+     MATCH.
+   */
+  std::vector<int> Matcher::closure(std::vector<int> pcs, bool bol, bool eol) {
+
+    const auto& prog = this->re->program;
+    std::vector<char> seen(prog.size(), 0);
+    std::vector<int> out;
+
+    while(!pcs.empty()) {
+      const int pc = pcs.back();
+      pcs.pop_back();
+
+      if(seen[pc])
+        continue;
+      seen[pc] = 1;
+
+      const auto& in = prog[pc];
+
+      switch(in.op) {
+      case Regex::inst_t::SPLIT:
+        pcs.push_back(in.y);
+        pcs.push_back(in.x);
+        break;
+      case Regex::inst_t::JMP:
+        pcs.push_back(in.x);
+        break;
+      case Regex::inst_t::BOL:
+        if(bol)
+          pcs.push_back(pc + 1);
+        break;
+      case Regex::inst_t::EOL:
+        if(eol)
+          pcs.push_back(pc + 1);
+        else
+          out.push_back(pc);
+        break;
+      default:
+        out.push_back(pc);
+      }
+    }
+
+    std::sort(out.begin(), out.end());
+    return out;
+
+  }
+
+
+  int Matcher::intern(Cache& c, std::vector<int> set) {
+
+    if(set.empty())
+      return -2;
+
+    auto it = c.ids.find(set);
+    if(it != c.ids.end())
+      return it->second;
+
+    // full, start over. Callers only keep the id returned.
+    if(c.states.size() >= MAX_STATES) {
+      c.states.clear();
+      c.ids.clear();
+      c.start[0] = c.start[1] = -1;
+    }
+
+    const auto& prog = this->re->program;
+
+    state_t s;
+    s.set = set;
+    memset(s.next, -1, sizeof(s.next));
+
+    std::vector<int> waiting;
+    for(int pc : set) {
+      if(prog[pc].op == Regex::inst_t::MATCH)
+        s.match = true;
+      else if(prog[pc].op == Regex::inst_t::EOL)
+        waiting.push_back(pc);
+    }
+
+    s.match_at_end = s.match;
+    if(!s.match_at_end && !waiting.empty()) {
+      for(int pc : this->closure(waiting, false, true))
+        if(prog[pc].op == Regex::inst_t::MATCH)
+          s.match_at_end = true;
+    }
+
+    c.states.push_back(std::move(s));
+    c.ids[set] = c.states.size() - 1;
+
+    return c.states.size() - 1;
+
+  }
+
+
+  int Matcher::start_state(Cache& c, bool bol) {
+    int& s = c.start[bol];
+    if(s < 0) {
+      const int id = this->intern(c, this->closure({0}, bol, false));
+      // interning may have flushed the cache, start[] included.
+      c.start[bol] = id;
+      return id;
+    }
+    return s;
+  }
+
+
+  int Matcher::step(Cache& c, int s, unsigned char byte) {
+
+    const int cached = c.states[s].next[byte];
+    if(cached != -1)
+      return cached;
+
+    const auto& prog = this->re->program;
+    std::vector<int> next;
+
+    for(int pc : c.states[s].set) {
+      if(prog[pc].op == Regex::inst_t::CLASS && this->re->classes[prog[pc].x][byte])
+        next.push_back(pc + 1);
+    }
+
+    // unanchored: a new match can start at every byte.
+    if(c.unanchored)
+      next.push_back(0);
+
+    const size_t before = c.states.size();
+    const int id = this->intern(c, this->closure(std::move(next), false, false));
+
+    // a flush leaves fewer states than before, s is gone then.
+    if(c.states.size() >= before)
+      c.states[s].next[byte] = id;
+
+    return id;
+
+  }
+
+
+  // is there a match anywhere from start, and where does the first one end.
+  bool Matcher::any(std::string_view a, std::string_view b, size_t start, size_t& end) {
+
+    auto& c = this->floating;
+    int s = this->start_state(c, start == 0);
+    const size_t len = a.size() + b.size();
+
+    if(s >= 0 && c.states[s].match) {
+      end = start;
+      return true;
+    }
+
+    for(size_t i = start; i < len && s >= 0; i++) {
+      const unsigned char byte = i < a.size() ? a[i] : b[i - a.size()];
+      s = this->step(c, s, byte);
+      if(s >= 0 && c.states[s].match) {
+        end = i + 1;
+        return true;
+      }
+    }
+
+    if(s >= 0 && c.states[s].match_at_end) {
+      end = len;
+      return true;
+    }
+
+    return false;
+
+  }
+
+
+  // end of the longest match starting exactly at from.
+  bool Matcher::longest(std::string_view a, std::string_view b, size_t from, size_t& end) {
+
+    auto& c = this->anchored;
+    int s = this->start_state(c, from == 0);
+    const size_t len = a.size() + b.size();
+
+    bool found = false;
+
+    if(s >= 0 && c.states[s].match) {
+      end = from;
+      found = true;
+    }
+
+    size_t i = from;
+    for(; i < len && s >= 0; i++) {
+      const unsigned char byte = i < a.size() ? a[i] : b[i - a.size()];
+      s = this->step(c, s, byte);
+      if(s >= 0 && c.states[s].match) {
+        end = i + 1;
+        found = true;
+      }
+    }
+
+    if(i == len && s >= 0 && c.states[s].match_at_end) {
+      end = len;
+      found = true;
+    }
+
+    return found;
+
+  }
+
+
+  // pc and what it reaches without reading a byte, unless a
+  // thread that started earlier got there first.
+  void Matcher::add_thread(std::vector<thread_t>& list, int pc, size_t start, bool bol, bool eol) {
+
+    if(this->seen[pc] == this->generation)
+      return;
+    this->seen[pc] = this->generation;
+
+    const auto& in = this->re->program[pc];
+
+    switch(in.op) {
+    case Regex::inst_t::SPLIT:
+      this->add_thread(list, in.x, start, bol, eol);
+      this->add_thread(list, in.y, start, bol, eol);
+      break;
+    case Regex::inst_t::JMP:
+      this->add_thread(list, in.x, start, bol, eol);
+      break;
+    case Regex::inst_t::BOL:
+      if(bol)
+        this->add_thread(list, pc + 1, start, bol, eol);
+      break;
+    case Regex::inst_t::EOL:
+      if(eol)
+        this->add_thread(list, pc + 1, start, bol, eol);
+      break;
+    default:
+      list.push_back({pc, start});
+    }
+
+  }
+
+
+  /**
+     leftmost
+
+     where the leftmost match at or after start begins, given
+     that one begins by last. Threads are kept in the order
+     they started, so the first one at a MATCH has the
+     earliest start of those matching here:
+
+       a*c|b   "aaab"       0: a*c   ...   3: a*c  b  <- match, start 3
+                                            4: (a*c died) done
+
+     once one matched no new threads start and the later ones
+     are dropped, it is over when no earlier thread is left.
+   */
+  bool Matcher::leftmost(std::string_view a, std::string_view b, size_t start, size_t last, size_t& begin) {
+
+    const auto& prog = this->re->program;
+    const size_t len = a.size() + b.size();
+
+    // a new list, nothing in it seen yet.
+    auto fresh = [&]() {
+      if(++this->generation == 0) {
+        std::fill(this->seen.begin(), this->seen.end(), 0);
+        this->generation = 1;
+      }
+    };
+
+    this->seen.resize(prog.size(), 0);
+    this->threads.clear();
+    fresh();
+
+    bool found = false;
+
+    for(size_t i = start; ; i++) {
+
+      if(!found && i <= last)
+        this->add_thread(this->threads, 0, i, i == 0, i == len);
+
+      for(size_t k = 0; k < this->threads.size(); k++) {
+        if(prog[this->threads[k].pc].op == Regex::inst_t::MATCH) {
+          found = true;
+          begin = this->threads[k].start;
+          this->threads.resize(k);
+          break;
+        }
+      }
+
+      if(found && (this->threads.empty() || this->threads.front().start >= begin))
+        return true;
+
+      if(i == len || (this->threads.empty() && i >= last))
+        return found;
+
+      const unsigned char byte = i < a.size() ? a[i] : b[i - a.size()];
+
+      fresh();
+      this->stepped.clear();
+
+      for(const auto& t : this->threads) {
+        const auto& in = prog[t.pc];
+        if(in.op == Regex::inst_t::CLASS && this->re->classes[in.x][byte])
+          this->add_thread(this->stepped, t.pc + 1, t.start, false, i + 1 == len);
+      }
+
+      std::swap(this->threads, this->stepped);
+    }
+
+  }
+
+
+  /**
+     search
+
+     the unanchored pass rules out lines without a match in
+     one go and gives the end of the first match to finish,
+     the leftmost match starts at or before it. leftmost()
+     finds that start, the anchored DFA then runs once from it
+     for the longest match.
+   */
+  bool Matcher::search(std::string_view a, std::string_view b, size_t start, size_t& begin, size_t& end) {
+
+    size_t first_end;
+    if(!this->any(a, b, start, first_end))
+      return false;
+
+    if(!this->leftmost(a, b, start, first_end, begin))
+      return false;
+
+    return this->longest(a, b, begin, end);
+
+  }
+
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace files {
+
+  /**
+
+     Regex
+
+     A small regular expression compiler. The pattern is
+     parsed into a Thompson NFA (a list of instructions) which
+     is never run by backtracking: Matcher turns it into a
+     DFA one state at a time as the text asks for them, so
+     matching is linear in the text whatever the pattern.
+
+       .  [abc] [^a-z]  \d \w \s (and \D \W \S)
+       ^ $  ( )  |  * + ?
+
+     Matching is per line ('.' never matches a newline) and
+     leftmost-longest.
+
+     A compiled Regex is read only and can be shared between
+     threads, each thread needs its own Matcher.
+
+   */
+  class Regex {
+  public:
+    typedef struct inst {
+      enum { CLASS, SPLIT, JMP, BOL, EOL, MATCH } op;
+      int x = 0; // CLASS: index into classes, SPLIT / JMP: target
+      int y = 0; // SPLIT: second target
+    } inst_t;
+
+    std::vector<inst_t> program;
+    std::vector<std::bitset<256>> classes;
+
+    std::string error; // why compile() failed
+
+    bool compile(std::string_view pattern);
+
+  private:
+    struct Node {
+      enum { CLASS, CAT, ALT, STAR, PLUS, QUEST, BOL, EOL, EMPTY } type;
+      int cls = 0;
+      int left = -1;
+      int right = -1;
+    };
+
+    std::vector<Node> nodes;
+    std::string_view pattern;
+    size_t pos = 0;
+
+    int node(Node n);
+    int parse_alt();
+    int parse_cat();
+    int parse_repeat();
+    int parse_atom();
+    bool parse_class(std::bitset<256>& set);
+    bool parse_escape(std::bitset<256>& set);
+    void emit(int n);
+  };
+
+
+  /**
+
+     Matcher
+
+     the lazily built DFA for one Regex. A state is the set of
+     NFA instructions alive after some input, the transitions
+     out of it are filled in on first use and cached. Two
+     caches are kept, anchored (a match must start where the
+     scan starts) and unanchored (a match may start anywhere,
+     used to skip lines that can't match). When a cache grows
+     past MAX_STATES it is thrown away and rebuilt.
+
+     A DFA state can't tell where its match started, so on a
+     line that does match the NFA is also stepped directly,
+     every thread carrying its start, up to the point where
+     the leftmost start is certain.
+
+     Text is given as the two halves of a gap buffer.
+
+   */
+  class Matcher {
+  public:
+    static constexpr size_t MAX_STATES = 2048;
+
+    Matcher(const Regex* re);
+
+    /**
+       search
+
+       leftmost-longest match in a + b starting at or after
+       `start`. The match is [begin, end).
+     */
+    bool search(std::string_view a, std::string_view b, size_t start, size_t& begin, size_t& end);
+
+  private:
+    typedef struct state {
+      std::vector<int> set;
+      bool match = false;        // a match ends here
+      bool match_at_end = false; // ... if this is the end of the line
+      int next[256];             // -1 not built yet, -2 no way on
+    } state_t;
+
+    struct Cache {
+      Cache(bool unanchored) : unanchored(unanchored) {}
+
+      bool unanchored;
+      std::vector<state_t> states;
+      std::map<std::vector<int>, int> ids;
+      int start[2] = {-1, -1}; // at the start of the line or not
+    };
+
+    typedef struct thread {
+      int pc;
+      size_t start; // where its match would begin
+    } thread_t;
+
+    const Regex* re;
+    Cache anchored{false};
+    Cache floating{true};
+
+    // kept between searches, only to save the allocations.
+    std::vector<thread_t> threads, stepped;
+    std::vector<uint32_t> seen; // generation a pc was last added in
+    uint32_t generation = 0;
+
+    std::vector<int> closure(std::vector<int> pcs, bool bol, bool eol);
+    int intern(Cache& c, std::vector<int> set);
+    int start_state(Cache& c, bool bol);
+    int step(Cache& c, int s, unsigned char byte);
+
+    bool any(std::string_view a, std::string_view b, size_t start, size_t& end);
+    bool longest(std::string_view a, std::string_view b, size_t from, size_t& end);
+    void add_thread(std::vector<thread_t>& list, int pc, size_t start, bool bol, bool eol);
+    bool leftmost(std::string_view a, std::string_view b, size_t start, size_t last, size_t& begin);
+  };
+
+}
@@ -0,0 +1,237 @@
+#include "replay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <ctype.h>
+#include <string.h>
+
+namespace terminal {
+
+
+  std::string script_line(std::string_view bytes) {
+
+    std::string line;
+    char hex[8];
+
+    for(size_t i = 0; i < bytes.size(); i++) {
+      const unsigned char c = bytes[i];
+
+      // a leading # or @ would read as a comment or a directive.
+      const bool lead = i == 0 && (c == '#' || c == '@');
+
+      if(c == '\\')
+        line += "\\\\";
+      else if(c == 27)
+        line += "\\e";
+      else if(c == '\r')
+        line += "\\r";
+      else if(c == '\n')
+        line += "\\n";
+      else if(c == '\t')
+        line += "\\t";
+      else if(c >= 32 && c < 127 && !lead)
+        line += c;
+      else {
+        snprintf(hex, sizeof(hex), "\\x%02x", c);
+        line += hex;
+      }
+    }
+
+    return line;
+
+  }
+
+
+  bool parse_script_line(std::string_view line, std::string& bytes) {
+
+    bytes.clear();
+
+    for(size_t i = 0; i < line.size(); i++) {
+
+      if(line[i] != '\\') {
+        bytes += line[i];
+        continue;
+      }
+
+      if(++i == line.size())
+        return false;
+
+      switch(line[i]) {
+      case '\\': bytes += '\\'; break;
+      case 'e':  bytes += '\x1b'; break;
+      case 'r':  bytes += '\r'; break;
+      case 'n':  bytes += '\n'; break;
+      case 't':  bytes += '\t'; break;
+      case 'x': {
+        const std::string digits(line.substr(i + 1, 2));
+        char* end;
+        const long v = strtol(digits.c_str(), &end, 16);
+        if(digits.size() != 2 || *end != '\0' || !isxdigit(digits[0]))
+          return false;
+        bytes += static_cast<char>(v);
+        i += 2;
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+
+    return true;
+
+  }
+
+
+  bool Replay_Backend::load(const char* path) {
+
+    std::ifstream in(path);
+    if(!in)
+      return false;
+
+    for(std::string line; std::getline(in, line); ) {
+
+      if(line.empty() || line[0] == '#')
+        continue;
+
+      step_t s;
+
+      if(line[0] == '@') {
+        if(sscanf(line.c_str(), "@resize %zu %zu", &s.columns, &s.rows) != 2 || s.columns == 0)
+          return false;
+      } else if(!parse_script_line(line, s.bytes)) {
+        return false;
+      }
+
+      this->steps.push_back(std::move(s));
+    }
+
+    return true;
+
+  }
+
+
+  Backend::wake_t Replay_Backend::wait(int timeout) {
+
+    wake_t w;
+
+    if(this->pending_read < this->pending.size()) {
+      w.input = true;
+      return w;
+    }
+
+    // the frame for the last step is still to come, unless the
+    // editor is about to sleep for good: then it never will.
+    if(this->timing && timeout >= 0)
+      return w;
+
+    this->timing = false;
+
+    if(this->next == this->steps.size()) {
+      w.closed = true;
+      return w;
+    }
+
+    auto& s = this->steps[this->next++];
+
+    this->timing = true;
+    this->began = false;
+    this->delivered_at = clock::now();
+
+    if(s.columns != 0) {
+      this->columns = s.columns;
+      this->rows = s.rows;
+      w.resized = true;
+      return w;
+    }
+
+    this->pending = s.bytes;
+    this->pending_read = 0;
+    w.input = true;
+    return w;
+
+  }
+
+
+  ssize_t Replay_Backend::read(const struct iovec* iov, int n) {
+
+    ssize_t total = 0;
+
+    for(int i = 0; i < n && this->pending_read < this->pending.size(); i++) {
+      const size_t k = std::min(iov[i].iov_len, this->pending.size() - this->pending_read);
+      memcpy(iov[i].iov_base, this->pending.data() + this->pending_read, k);
+      this->pending_read += k;
+      total += k;
+    }
+
+    return total;
+
+  }
+
+
+  void Replay_Backend::frame_begin() {
+    if(this->timing && !this->began) {
+      this->began = true;
+      this->began_at = clock::now();
+    }
+  }
+
+
+  void Replay_Backend::write(const struct iovec* iov, int n) {
+
+    this->writes++;
+    this->last.clear();
+
+    for(int i = 0; i < n; i++) {
+      this->last.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+      this->bytes += iov[i].iov_len;
+    }
+
+    // the frame a step was waiting for.
+    if(this->timing && this->pending_read == this->pending.size()) {
+      const auto now = clock::now();
+      const auto began = this->began ? this->began_at : now;
+
+      this->samples.push_back({
+        std::chrono::duration<double>(began - this->delivered_at).count(),
+        std::chrono::duration<double>(now - began).count(),
+      });
+
+      this->timing = false;
+    }
+
+  }
+
+
+  std::pair<size_t, size_t> Replay_Backend::size() {
+    return {this->columns, this->rows};
+  }
+
+
+  void Replay_Backend::report(FILE* out) {
+
+    auto line = [&](const char* name, auto get) {
+      std::vector<double> v;
+      for(const auto& s : this->samples)
+        v.push_back(get(s) * 1e6);
+      std::sort(v.begin(), v.end());
+
+      auto at = [&](double p) {
+        if(v.empty())
+          return 0.0;
+        const size_t i = std::ceil(p * v.size());
+        return v[std::min(v.size(), std::max<size_t>(i, 1)) - 1];
+      };
+
+      fprintf(out, "%-8s %10.1f %10.1f %10.1f\n", name, at(0.5), at(0.99), v.empty() ? 0.0 : v.back());
+    };
+
+    fprintf(out, "steps %zu  writes %zu  bytes %zu\n", this->samples.size(), this->writes, this->bytes);
+    fprintf(out, "%-8s %10s %10s %10s   (us)\n", "", "p50", "p99", "max");
+    line("process", [](const sample_t& s) { return s.process; });
+    line("render", [](const sample_t& s) { return s.render; });
+    line("total", [](const sample_t& s) { return s.process + s.render; });
+
+  }
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "terminal.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace terminal {
+
+  // the bytes of one read as one line of a replay script, and back.
+  std::string script_line(std::string_view bytes);
+  bool parse_script_line(std::string_view line, std::string& bytes);
+
+
+  /**
+
+     Replay_Backend
+
+     a terminal with nobody at it. The script is a text file,
+     each line what one read of the tty returned (a key, or a
+     burst typed faster than frames were drawn), escaped so it
+     stays one line. `alter --record` writes them.
+
+       # comments and blank lines are skipped
+       hello             typed text
+       \x0e              ctrl-n
+       \e[A              up arrow
+       \r                enter
+       @resize 120 40    the terminal changes size
+
+     A line is only handed over once the frame for the one
+     before it has been written, so each step is timed from
+     the read to the paint:
+
+       read ....... frame_begin() ....... write()
+       |-- process --|------ render ------|
+
+     Frames go to memory and are only counted. When the script
+     runs out the input reports closed, which ends run().
+
+   */
+  class Replay_Backend : public Backend {
+  public:
+    typedef struct sample {
+      double process; // seconds, from the read to frame_begin()
+      double render;  // from frame_begin() to the write
+    } sample_t;
+
+    size_t columns = 100;
+    size_t rows = 30;
+
+    std::vector<sample_t> samples;
+    size_t writes = 0;
+    size_t bytes = 0;   // everything written to the "screen"
+    std::string last;   // the last write, i.e. the last frame
+
+    bool load(const char* path); // false if it can't be read or parsed
+    void report(FILE* out);      // p50 / p99 / max of every sample
+
+    void setup() override {}
+    void cleanup() override {}
+    wake_t wait(int timeout) override;
+    ssize_t read(const struct iovec* iov, int n) override;
+    void write(const struct iovec* iov, int n) override;
+    std::pair<size_t, size_t> size() override;
+    void frame_begin() override;
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    typedef struct step {
+      std::string bytes;
+      size_t columns = 0; // a resize when not 0
+      size_t rows = 0;
+    } step_t;
+
+    std::vector<step_t> steps;
+    size_t next = 0;
+
+    std::string pending;     // handed over, not read yet
+    size_t pending_read = 0;
+
+    bool timing = false;     // a step is out, its frame not written yet
+    bool began = false;
+    clock::time_point delivered_at, began_at;
+  };
+
+}
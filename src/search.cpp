@@ -0,0 +1,229 @@
+#include "search.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace files {
+
+
+  static size_t find_scalar(const char* s, size_t n, const char* nd, size_t m) {
+
+    const char* end = s + n - m + 1;
+
+    for(auto p = s;
+        (p = static_cast<const char*>(memchr(p, nd[0], end - p))) != nullptr; p++) {
+      if(memcmp(p + 1, nd + 1, m - 1) == 0)
+        return p - s;
+    }
+
+    return npos;
+
+  }
+
+
+#ifdef SEARCH_X86
+
+  /**
+     first and last byte filter: for every candidate position
+     i the block at s + i is compared with needle[0] and the
+     block at s + i + m - 1 with needle[m - 1]. A bit set in
+     both masks is a position worth a memcmp.
+   */
+
+  __attribute__((target("sse2")))
+  static size_t find_sse2(const char* s, size_t n, const char* nd, size_t m) {
+
+    const __m128i first = _mm_set1_epi8(nd[0]);
+    const __m128i last = _mm_set1_epi8(nd[m - 1]);
+    size_t i = 0;
+
+    for(; i + m - 1 + 16 <= n; i += 16) {
+      const __m128i bf = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+      const __m128i bl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + m - 1));
+
+      uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+
+      while(mask) {
+        const size_t at = i + __builtin_ctz(mask);
+        if(memcmp(s + at + 1, nd + 1, m - 2) == 0)
+          return at;
+        mask &= mask - 1;
+      }
+    }
+
+    const size_t r = find_scalar(s + i, n - i, nd, m);
+    return r == npos ? npos : i + r;
+
+  }
+
+
+  __attribute__((target("avx2")))
+  static size_t find_avx2(const char* s, size_t n, const char* nd, size_t m) {
+
+    const __m256i first = _mm256_set1_epi8(nd[0]);
+    const __m256i last = _mm256_set1_epi8(nd[m - 1]);
+    size_t i = 0;
+
+    for(; i + m - 1 + 32 <= n; i += 32) {
+      const __m256i bf = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+      const __m256i bl = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + m - 1));
+
+      uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+
+      while(mask) {
+        const size_t at = i + __builtin_ctz(mask);
+        if(memcmp(s + at + 1, nd + 1, m - 2) == 0)
+          return at;
+        mask &= mask - 1;
+      }
+    }
+
+    const size_t r = find_scalar(s + i, n - i, nd, m);
+    return r == npos ? npos : i + r;
+
+  }
+
+#endif
+
+
+  size_t find_literal(Scan_Kernel k, std::string_view hay, std::string_view needle) {
+
+    const size_t n = hay.size();
+    const size_t m = needle.size();
+
+    if(m == 0)
+      return 0;
+    if(n < m)
+      return npos;
+
+    // a single byte is what memchr is for.
+    if(m == 1) {
+      auto p = static_cast<const char*>(memchr(hay.data(), needle[0], n));
+      return p ? p - hay.data() : npos;
+    }
+
+    switch(k) {
+#ifdef SEARCH_X86
+    case Scan_Kernel::avx2:
+      return find_avx2(hay.data(), n, needle.data(), m);
+    case Scan_Kernel::sse2:
+      return find_sse2(hay.data(), n, needle.data(), m);
+#endif
+    default:
+      return find_scalar(hay.data(), n, needle.data(), m);
+    }
+
+  }
+
+
+  size_t find_literal(std::string_view hay, std::string_view needle) {
+    static const Scan_Kernel k = best_scan_kernel();
+    return find_literal(k, hay, needle);
+  }
+
+
+  size_t rfind_literal(std::string_view hay, std::string_view needle) {
+
+    const size_t n = hay.size();
+    const size_t m = needle.size();
+
+    if(m == 0)
+      return n;
+    if(n < m)
+      return npos;
+
+    // memrchr is vectorised in libc, candidates are rare.
+    for(size_t len = n - m + 1; len > 0; ) {
+      auto p = static_cast<const char*>(memrchr(hay.data(), needle[0], len));
+      if(p == nullptr)
+        return npos;
+      if(memcmp(p + 1, needle.data() + 1, m - 1) == 0)
+        return p - hay.data();
+      len = p - hay.data();
+    }
+
+    return npos;
+
+  }
+
+
+  size_t find_split(std::string_view a, std::string_view b, std::string_view needle, size_t start) {
+
+    const size_t m = needle.size();
+
+    if(start < a.size()) {
+      const size_t r = find_literal(a.substr(start), needle);
+      if(r != npos)
+        return start + r;
+    }
+
+    // across the gap, needs a byte from each side.
+    if(m > 1 && !a.empty() && !b.empty()) {
+      const size_t from = std::max(start, a.size() > m - 1 ? a.size() - (m - 1) : 0);
+
+      if(from < a.size()) {
+        std::string seam(a.substr(from));
+        seam += b.substr(0, m - 1);
+
+        const size_t r = find_literal(seam, needle);
+        if(r != npos)
+          return from + r;
+      }
+    }
+
+    const size_t from = start > a.size() ? start - a.size() : 0;
+    if(from < b.size()) {
+      const size_t r = find_literal(b.substr(from), needle);
+      if(r != npos)
+        return a.size() + from + r;
+    }
+
+    return npos;
+
+  }
+
+
+  size_t rfind_split(std::string_view a, std::string_view b, std::string_view needle, size_t limit) {
+
+    const size_t m = needle.size();
+    if(m == 0)
+      return npos;
+
+    // last match in hay (which starts at base) starting before limit.
+    auto last_in = [&](std::string_view hay, size_t base) -> size_t {
+      if(base >= limit)
+        return npos;
+      // saturating, limit can be as big as it gets.
+      if(limit - base < hay.size())
+        hay = hay.substr(0, std::min(hay.size(), limit - base + m - 1));
+      const size_t r = rfind_literal(hay, needle);
+      return r == npos ? npos : base + r;
+    };
+
+    size_t r = last_in(b, a.size());
+    if(r != npos)
+      return r;
+
+    if(m > 1 && !a.empty() && !b.empty()) {
+      const size_t from = a.size() > m - 1 ? a.size() - (m - 1) : 0;
+
+      std::string seam(a.substr(from));
+      seam += b.substr(0, m - 1);
+
+      r = last_in(seam, from);
+      if(r != npos)
+        return r;
+    }
+
+    return last_in(a, 0);
+
+  }
+
+}
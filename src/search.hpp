@@ -0,0 +1,47 @@
+#pragma once
+
+#include "line_index.hpp"
+#include <cstddef>
+#include <string_view>
+
+
+namespace files {
+
+  /**
+
+     Literal substring search.
+
+     The vector kernels compare a block of the text against
+     the first and the last byte of the needle at once and
+     only memcmp where both agree, which on real text is
+     almost never, so a long scan runs at memory speed. The
+     kernel is picked at runtime the same way as for the
+     newline scan (see Scan_Kernel).
+
+   */
+
+  constexpr size_t npos = std::string_view::npos;
+
+  // first / last occurrence of needle in hay, npos if none.
+  size_t find_literal(std::string_view hay, std::string_view needle);
+  size_t find_literal(Scan_Kernel k, std::string_view hay, std::string_view needle);
+  size_t rfind_literal(std::string_view hay, std::string_view needle);
+
+
+  /**
+     find_split / rfind_split
+
+     search the text a + b, the two halves of a gap buffer,
+     without joining them. Only a match straddling the gap is
+     looked for in a scratch copy of the at most
+     2 * (needle - 1) bytes around it.
+
+     find_split:  first match starting at or after `start`
+     rfind_split: last match starting before `limit`
+
+     Positions are into a + b.
+   */
+  size_t find_split(std::string_view a, std::string_view b, std::string_view needle, size_t start);
+  size_t rfind_split(std::string_view a, std::string_view b, std::string_view needle, size_t limit);
+
+}
@@ -1,11 +1,26 @@
 #include "terminal.hpp"
 #include "file.hpp"
 #include "gap_buffer.hpp"
+#include "replay.hpp"
+#include "utf8.hpp"
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <deque>
 #include <functional>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
 
 
 namespace terminal {
@@ -13,77 +28,262 @@ namespace terminal {
 
   terminal_meta_t tconf;
 
-  const int append_buffer_size = 4096;
+  // starting size, the buffer doubles whenever a frame needs more.
+  const size_t append_buffer_size = 4096;
 
   struct {
-    char *b;
-    int len = 0;
-    int free = append_buffer_size;
-    int pushed_lines = 0;
+    char *b = nullptr;
+    size_t len = 0;
+    size_t capacity = 0;
   } append_buffer;
 
 
-  void append_buffer_push(const char* data, int len) {
-    if(append_buffer.free >= len) {
-      memcpy(&append_buffer.b[append_buffer.len], data, len);
-      append_buffer.len += len;
-      append_buffer.free -= len;
+  // room for len more bytes, then append_buffer_copy() needs no checks.
+  void append_buffer_reserve(size_t len) {
+    if(append_buffer.len + len > append_buffer.capacity) [[unlikely]] {
+      size_t capacity = append_buffer.capacity ? append_buffer.capacity * 2 : append_buffer_size;
+      while(capacity < append_buffer.len + len)
+        capacity *= 2;
+
+      char* nb = new char[capacity];
+      memcpy(nb, append_buffer.b, append_buffer.len);
+      delete[] append_buffer.b;
+
+      append_buffer.b = nb;
+      append_buffer.capacity = capacity;
     }
+
+  }
+
+  inline void append_buffer_copy(const char* data, size_t len) {
+    memcpy(&append_buffer.b[append_buffer.len], data, len);
+    append_buffer.len += len;
+  }
+
+  void append_buffer_push(const char* data, size_t len) {
+    append_buffer_reserve(len);
+    append_buffer_copy(data, len);
   };
 
+  /**
+     What is on the terminal right now, one string per row,
+     as it was pushed (escape codes included). draw_rows()
+     compares the new frame against it and only sends what
+     changed.
+   */
+  struct {
+    std::vector<std::string> rows;
+    bool valid = false; // false forces a full repaint
+    std::string out;    // bytes for this frame's update
+  } screen;
+
+
   void append_buffer_clear() {
+    // the old bytes are simply overwritten by the next frame.
     append_buffer.len = 0;
-    append_buffer.pushed_lines = 0;
-    append_buffer.free = append_buffer_size;
+  }
+
+
+  io_stats_t stats;
+
+  const io_stats_t& io_stats() {
+    return stats;
+  }
+
+
+  // SIGWINCH -> one byte down this pipe, read end is polled.
+  int winch_pipe[2] = {-1, -1};
+
+  void on_winch(int) {
+    const int saved = errno;
+    const char b = 1;
+    write(winch_pipe[1], &b, 1);
+    errno = saved;
+  }
+
+
+  /**
+     Tty_Backend
+
+     the terminal the editor was started in: raw mode on
+     stdin, frames to stdout, SIGWINCH for resizes.
+   */
+  class Tty_Backend : public Backend {
+  public:
+
+    void setup() override {
+
+      enter_alternative_screen();
+
+      tcgetattr(STDIN_FILENO, &tconf.orig_termios);
+
+      struct termios raw = tconf.orig_termios;
+      raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+      raw.c_oflag &= ~(OPOST); // No Output Processing
+      raw.c_cflag |= (CS8);
+      raw.c_lflag &= ~(ECHO | ICANON | ISIG);
+      // reads never block, wait() polls for input instead.
+      raw.c_cc[VMIN] = 0;
+      raw.c_cc[VTIME] = 0;
+      tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+      // pastes arrive wrapped in ESC[200~ ... ESC[201~ so they
+      // can be inserted as one block instead of typed out.
+      ::write(STDOUT_FILENO, "\x1b[?2004h", 8);
+
+      // a resize wakes wait() through the self pipe.
+      if(pipe2(winch_pipe, O_NONBLOCK | O_CLOEXEC) == 0) {
+        struct sigaction sa = {};
+        sa.sa_handler = on_winch;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGWINCH, &sa, nullptr);
+      }
 
-    // manually wiping the append buffer content.
-    for(int i = 0; i < append_buffer_size; i++) {
-      append_buffer.b[i] = ' '; 
     }
-    
+
+    void cleanup() override {
+      tcsetattr(STDIN_FILENO, TCSAFLUSH, &tconf.orig_termios);
+      ::write(STDOUT_FILENO, "\x1b[?2004l", 8); // bracketed paste off
+      exit_alternative_screen();
+    }
+
+    wake_t wait(int timeout) override {
+
+      wake_t w;
+
+      struct pollfd p[2] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {winch_pipe[0], POLLIN, 0},
+      };
+
+      stats.syscalls++;
+      if(poll(p, winch_pipe[0] >= 0 ? 2 : 1, timeout) <= 0)
+        return w;
+
+      if(p[1].revents & POLLIN) {
+        char drain[64];
+        do
+          stats.syscalls++;
+        while(::read(winch_pipe[0], drain, sizeof(drain)) > 0);
+        w.resized = true;
+      }
+
+      w.input = p[0].revents & POLLIN;
+
+      // the terminal went away, nothing will ever arrive again.
+      w.closed = !w.input && (p[0].revents & (POLLHUP | POLLERR));
+
+      return w;
+
+    }
+
+    ssize_t read(const struct iovec* iov, int n) override {
+      stats.syscalls++;
+      return readv(STDIN_FILENO, iov, n);
+    }
+
+    void write(const struct iovec* in, int count) override {
+
+      // a copy, partial writes move the bases along.
+      std::vector<struct iovec> iov(in, in + count);
+
+      for(int i = 0; i < count; ) {
+        stats.syscalls++;
+        auto n = writev(STDOUT_FILENO, iov.data() + i, std::min(count - i, IOV_MAX));
+        if(n < 0) {
+          if(errno == EINTR)
+            continue;
+          break;
+        }
+
+        // a pty may take less than all of it.
+        for(; i < count && (size_t) n >= iov[i].iov_len; i++)
+          n -= iov[i].iov_len;
+
+        if(i < count) {
+          iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + n;
+          iov[i].iov_len -= n;
+        }
+      }
+
+    }
+
+    std::pair<size_t, size_t> size() override {
+      struct winsize ws;
+      stats.syscalls++;
+      if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1)
+        return {0, 0};
+      return {ws.ws_col, ws.ws_row};
+    }
+
+  };
+
+
+  Tty_Backend tty;
+  Backend* backend = &tty;
+
+  FILE* recording = nullptr; // replay script being written, see record_input()
+
+
+  void set_backend(Backend* b) {
+    backend = b;
   }
-  
-  
+
+
+  void record_input(const char* path) {
+    recording = fopen(path, "w");
+  }
+
+
+  void frame_begin() {
+    backend->frame_begin();
+  }
+
+
+  static void backend_write(const struct iovec* iov, int n) {
+    for(int i = 0; i < n; i++)
+      stats.bytes_out += iov[i].iov_len;
+    backend->write(iov, n);
+  }
+
+
+  // control sequences outside of frames.
+  static void send(const char* b, size_t n) {
+    struct iovec v = {const_cast<char*>(b), n};
+    backend_write(&v, 1);
+  }
+
+
   void cleanup_terminal() {
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &tconf.orig_termios);
-    terminal::exit_alternative_screen();
-    
+    backend->cleanup();
+    if(recording != nullptr)
+      fclose(recording);
+    recording = nullptr;
   }
   
   
   void setup_terminal() {
 
-    terminal::enter_alternative_screen();
-    
-    tcgetattr(STDIN_FILENO, &tconf.orig_termios);
+    backend->setup();
     atexit(cleanup_terminal);
-    
-    struct termios raw = tconf.orig_termios;
-    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
-    raw.c_oflag &= ~(OPOST); // No Output Processing
-    raw.c_cflag |= (CS8);
-    raw.c_lflag &= ~(ECHO | ICANON | ISIG);
-    raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
-    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
 
     // allocate screen buffer. Big buffer >> small allocations
     append_buffer.b = new char[append_buffer_size];
-
+    append_buffer.capacity = append_buffer_size;
 
     poll_terminal_size();
     
   }
   
   void clear_terminal() {
-
-    append_buffer_push("\x1b[2J", 4);
-    //    write(STDOUT_FILENO, "\x1b[2J", 4);
+    // repaint everything on the next draw.
+    screen.valid = false;
   }
   
   
   void send_cursor_home() {
-    write(STDOUT_FILENO, "\x1b[H", 3);
+    send("\x1b[H", 3);
   }
 
 
@@ -92,20 +292,145 @@ namespace terminal {
   }
   
 
+  /**
+     plain_prefix
+
+     the screen column byte i of row lands on (a character
+     takes its display width), false if i is
+     inside an escape code or the colours before it haven't
+     been reset (the row then has to be sent from the start).
+   */
+  static bool plain_prefix(std::string_view row, size_t i, size_t& col) {
+
+    bool plain = true;
+    col = 0;
+
+    for(size_t p = 0; p < i; ) {
+
+      if(static_cast<unsigned char>(row[p]) < 0x80 && row[p] != '\x1b') {
+        col++;
+        p++;
+        continue;
+      }
+
+      if(row[p] != '\x1b') {
+        uint32_t cp;
+        p += files::decode_utf8(row.data() + p, i - p, cp);
+        col += files::char_width(cp);
+        continue;
+      }
+
+      size_t q = p + 1;
+      if(q < row.size() && row[q] == '[') {
+        q++;
+        while(q < row.size() && !(row[q] >= 0x40 && row[q] <= 0x7e))
+          q++;
+      }
+
+      if(q >= i)
+        return false;
+
+      auto seq = row.substr(p, q - p + 1);
+      plain = (seq == "\x1b[0m" || seq == "\x1b[m");
+      p = q + 1;
+    }
+
+    return plain;
+
+  }
+
+
+  // send the part of row r that differs from what is on screen.
+  static void draw_row_update(size_t r, std::string_view row) {
+
+    char buf[32];
+    size_t from = 0;
+    size_t col = 0;
+
+    if(screen.valid && r < screen.rows.size()) {
+      const auto& old = screen.rows[r];
+
+      if(old == row)
+        return;
+
+      size_t i = 0;
+      while(i < old.size() && i < row.size() && old[i] == row[i])
+        i++;
+
+      // start on a whole character, and not on a mark that
+      // belongs with the character before it.
+      while(i > 0 && i < row.size()) {
+        uint32_t cp;
+        if(!files::is_continuation(row[i])) {
+          files::decode_utf8(row.data() + i, row.size() - i, cp);
+          if(files::char_width(cp) != 0)
+            break;
+        }
+        i--;
+      }
+
+      if(plain_prefix(row, i, col))
+        from = i;
+      else
+        col = 0;
+    }
+
+    snprintf(buf, sizeof(buf), "\x1b[%zu;%zuH", r + 1, col + 1);
+    screen.out += buf;
+    screen.out += row.substr(from);
+    screen.out += "\x1b[K";
+
+  }
+
+
   void draw_rows() {
-    
-    send_cursor_home();
-    
-      
+
+    // split the frame into terminal rows.
+    std::vector<std::string_view> rows;
+    std::string_view frame(append_buffer.b, append_buffer.len);
+
+    for(size_t p = 0; rows.size() < tconf.rows; ) {
+      auto nl = frame.find("\r\n", p);
+      rows.push_back(frame.substr(p, nl == std::string_view::npos ? nl : nl - p));
+      if(nl == std::string_view::npos)
+        break;
+      p = nl + 2;
+    }
+
+    screen.out.clear();
+    screen.out += "\x1b[?25l"; // hide the cursor while rows change
+
+    if(!screen.valid)
+      screen.out += "\x1b[2J";
+
+    for(size_t r = 0; r < rows.size(); r++) {
+      draw_row_update(r, rows[r]);
+    }
+
+    // rows the last frame drew that this one doesn't.
+    for(size_t r = rows.size(); screen.valid && r < screen.rows.size(); r++) {
+      if(!screen.rows[r].empty())
+        draw_row_update(r, "");
+    }
+
     // Draw Cursor at pasition in tconf
     char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", tconf.cy + 1, tconf.cx + 1);
-    append_buffer_push(buf, strlen(buf));
-   
-    write(STDOUT_FILENO, append_buffer.b, append_buffer.len);
-    
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH\x1b[?25h", tconf.cy + 1, tconf.cx + 1);
+    screen.out += buf;
+
+    // cursor home and the update go out in a single write.
+    struct iovec iov[2] = {
+      {const_cast<char*>("\x1b[H"), 3},
+      {screen.out.data(), screen.out.size()},
+    };
+
+    backend_write(iov, 2);
+
+    screen.rows.assign(rows.begin(), rows.end());
+    screen.valid = true;
+
     append_buffer_clear();
-    
+
   }
 
 
@@ -136,27 +461,223 @@ namespace terminal {
   }
 
 
-  void put_line_obj(files::Editor_File::Line *l) {
-    const auto col = tconf.columns - 5;
-    const auto strlen = l->buf->get_strlen();    
-    const std::string wrap_str ="\r\n\033[37;44m^^^^\033[0m ";    
+  render_mode_t render;
 
-    int chars_written = 0;
-    l->wrapping = 0;
-    
-    for(auto c : *l->buf) {
-      if(chars_written % col == 0 && chars_written != 0) {
-        append_buffer_push(wrap_str.c_str(), wrap_str.length());
-        l->wrapping++;
+  render_mode_t get_render_mode() {
+    return render;
+  }
+
+  void set_render_mode(render_mode_t mode) {
+    render = mode;
+    screen.valid = false;
+  }
+
+  int gutter_width() {
+    return render.numbers ? 5 : 0;
+  }
+
+  // columns left for text once the gutter is drawn.
+  static size_t text_columns() {
+    const size_t g = gutter_width();
+    return tconf.columns > g ? tconf.columns - g : 1;
+  }
+
+  int wrap_width() {
+    // a line is never longer than this, so it always fits one row.
+    return render.wrap ? text_columns() : 1 << 30;
+  }
+
+
+  /**
+     Line_Label
+
+     the gutter's "\033[37;44m0042\033[0m ", kept as text. The
+     next line's number is counted up in place, the way {:04}
+     prints it, instead of formatting every row of every frame.
+   */
+  class Line_Label {
+  public:
+    void set(int n) {
+      this->number = n;
+      this->len = snprintf(this->b, sizeof(this->b), "\033[37;44m%04d\033[0m ", n);
+    }
+
+    void next() {
+      // digits end where the "\033[0m " does.
+      for(size_t i = this->len - 6; i >= prefix; i--) {
+        if(this->b[i] != '9') {
+          this->b[i]++;
+          this->number++;
+          return;
+        }
+        this->b[i] = '0';
       }
-      
-      append_buffer_push(&c, 1);
-      chars_written++;
+
+      // 9999 -> 10000, one digit more.
+      this->set(this->number + 1);
     }
 
-    append_buffer_push("\r\n", 2);
+    const char* data() const { return this->b; }
+    size_t size() const { return this->len; }
 
-    
+  private:
+    static const size_t prefix = 8; // "\033[37;44m"
+    char b[40];
+    size_t len = 0;
+    int number = 0;
+  };
+
+
+  /**
+     put_utf8_rows
+
+     the rows of a line whose characters aren't all a byte and
+     a column each. Wrapped, the rows are where measure() broke
+     them; cut at the edge, only the first row is laid out to
+     find it. Each row is then copied out of the gap buffer as
+     it is, in two parts when the gap falls inside it.
+   */
+  static void put_utf8_rows(files::Line* l, size_t cols, int n, std::string_view next_row) {
+
+    const auto a = l->before_cursor();
+    const auto b = l->after_cursor();
+
+    size_t end = a.size() + b.size();
+
+    if(l->wrap_cols != cols) {
+      files::lay_out(a, b, cols, [&](size_t at, uint32_t row, uint32_t, int) {
+        if(row == 0)
+          return true;
+        end = at;
+        return false;
+      });
+    } else if((uint32_t) n < l->rows) {
+      end = l->row_start(n);
+    }
+
+    append_buffer_reserve(end + n * next_row.size());
+
+    for(int r = 0; r < n; r++) {
+      if(r > 0)
+        append_buffer_copy(next_row.data(), next_row.size());
+
+      const size_t s = l->wrap_cols == cols ? l->row_start(r) : 0;
+      const size_t e = r + 1 < n ? l->row_start(r + 1) : end;
+
+      if(e <= a.size()) {
+        append_buffer_copy(a.data() + s, e - s);
+      } else if(s >= a.size()) {
+        append_buffer_copy(b.data() + s - a.size(), e - s);
+      } else {
+        append_buffer_copy(a.data() + s, a.size() - s);
+        append_buffer_copy(b.data(), e - a.size());
+      }
+    }
+
+  }
+
+
+  /**
+     put_lines_as
+
+     the frame's lines laid out in one mode, picked at compile
+     time so nothing inside the loops asks which it is. Each
+     line reserves what it needs up front, then every row is
+     one copy straight out of the gap buffer, or two when the
+     gap falls inside it:
+
+       [ label ][ row 0              ]\r\n
+       [ ^^^^  ][ row 1        ]\r\n
+
+     Without wrapping a line is cut at the right edge. Lines
+     of wide or combining characters take put_utf8_rows().
+   */
+  template<bool Wrap, bool Numbers>
+  int put_lines_as(files::Editor_File* f, int from, int to, int max_rows) {
+
+    constexpr std::string_view next_row = Numbers ? "\r\n\033[37;44m^^^^\033[0m " : "\r\n";
+    const size_t cols = text_columns();
+    const uint32_t measure_cols = wrap_width();
+
+    Line_Label label;
+    if constexpr (Numbers)
+      label.set(from);
+
+    int rows = max_rows;
+    int i = from;
+
+    for(; i < to && rows > 0; i++) {
+      auto l = f->line_at(i);
+
+      const auto a = l->before_cursor();
+      const auto b = l->after_cursor();
+      const size_t len = a.size() + b.size();
+
+      // measured either way, that says which kind of line it is.
+      int n = l->display_rows(measure_cols);
+      if constexpr (Wrap)
+        n = std::min(n, rows);
+      else
+        n = 1;
+
+      if(l->encoding == files::Line::UTF8) [[unlikely]] {
+        append_buffer_reserve(label.size());
+        if constexpr (Numbers) {
+          append_buffer_copy(label.data(), label.size());
+          label.next();
+        }
+
+        put_utf8_rows(l, cols, n, next_row);
+        append_buffer_push("\r\n", 2);
+        rows -= n;
+        continue;
+      }
+
+      const size_t shown = std::min(len, n * cols);
+
+      // the last row's "\r\n" fits where a next_row would be.
+      append_buffer_reserve(label.size() + shown + n * next_row.size());
+
+      if constexpr (Numbers) {
+        append_buffer_copy(label.data(), label.size());
+        label.next();
+      }
+
+      for(int r = 0; r < n; r++) {
+        if(r > 0)
+          append_buffer_copy(next_row.data(), next_row.size());
+
+        const size_t s = r * cols;
+        const size_t e = std::min(s + cols, shown);
+
+        if(e <= a.size()) {
+          append_buffer_copy(a.data() + s, e - s);
+        } else if(s >= a.size()) {
+          append_buffer_copy(b.data() + s - a.size(), e - s);
+        } else {
+          append_buffer_copy(a.data() + s, a.size() - s);
+          append_buffer_copy(b.data(), e - a.size());
+        }
+      }
+
+      append_buffer_copy("\r\n", 2);
+      rows -= n;
+    }
+
+    return i - from;
+
+  }
+
+
+  int put_lines(files::Editor_File* f, int from, int to, int max_rows) {
+    if(render.wrap)
+      return render.numbers
+        ? put_lines_as<true, true>(f, from, to, max_rows)
+        : put_lines_as<true, false>(f, from, to, max_rows);
+
+    return render.numbers
+      ? put_lines_as<false, true>(f, from, to, max_rows)
+      : put_lines_as<false, false>(f, from, to, max_rows);
   }
 
 
@@ -168,21 +689,23 @@ namespace terminal {
 
 
   void enter_alternative_screen() {    
-    write(STDOUT_FILENO, "\x1b[?1049h", 8); // Switch to alternate buffer
+    send("\x1b[?1049h", 8); // Switch to alternate buffer
   }
 
   void exit_alternative_screen() {
-    write(STDOUT_FILENO, "\x1b[?1049l", 8); // Return to normal buffer
+    send("\x1b[?1049l", 8); // Return to normal buffer
   }
 
 
   void poll_terminal_size() {
-    struct winsize ws;
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != -1
-        || ws.ws_col != 0) {
-      
-      tconf.columns = ws.ws_col;
-      tconf.rows = ws.ws_row;
+    auto [columns, rows] = backend->size();
+    if(columns != 0) {
+
+      if(columns != tconf.columns || rows != tconf.rows)
+        screen.valid = false;
+
+      tconf.columns = columns;
+      tconf.rows = rows;
     }
   }
 
@@ -196,17 +719,329 @@ namespace terminal {
   }
  
 
-  std::function<char()> get_input() {
-    return []() -> char {
-      char c;
-      read(STDIN_FILENO, &c, 1);
-      return c;
+  /**
+     Input ring
+
+     bytes read from stdin that have not been decoded yet.
+     head and tail only ever count up, masking gives the slot.
+     An escape sequence cut in half by a read stays here until
+     the rest of it arrives.
+
+     [ - - - h a b c t - - - ]
+             ^       ^
+             head    tail
+   */
+  const size_t input_ring_size = 1 << 16;
+  const size_t input_ring_mask = input_ring_size - 1;
+
+  // wait this long after a lone ESC before deciding it is the key.
+  const int escape_timeout_ms = 25;
+
+  struct {
+    char b[input_ring_size];
+    size_t head = 0;
+    size_t tail = 0;
+    bool pasting = false; // inside ESC[200~ ... ESC[201~
+    std::string paste;
+    bool resized = false; // seen while waiting for input, not reported yet
+    std::deque<key_event_t> unread; // decoded but handed back, see unread_keys()
+  } input;
+
+
+  inline size_t input_pending() {
+    return input.tail - input.head;
+  }
+
+  inline char input_at(size_t i) {
+    return input.b[(input.head + i) & input_ring_mask];
+  }
+
+
+  // a resize is kept for wait_events() to report, and goes
+  // into the script being recorded so a replay sees it too.
+  Backend::wake_t backend_wait(int timeout) {
+
+    const auto t0 = std::chrono::steady_clock::now();
+    const auto w = backend->wait(timeout);
+    stats.wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - t0).count();
+    input.resized |= w.resized;
+
+    if(w.resized && recording != nullptr) {
+      const auto [cols, rows] = backend->size();
+      fprintf(recording, "@resize %zu %zu\n", cols, rows);
+      fflush(recording);
+    }
+
+    return w;
+
+  }
+
+
+  // read whatever is waiting on stdin into the ring with one
+  // readv, waiting up to timeout ms for something to show up.
+  size_t input_fill(int timeout) {
+
+    const size_t free = input_ring_size - input_pending();
+    if(free == 0)
+      return 0;
+
+    const auto w = backend_wait(timeout);
+    if(!w.input)
+      return 0;
+
+    const size_t at = input.tail & input_ring_mask;
+    const size_t first = std::min(free, input_ring_size - at);
+
+    struct iovec iov[2] = {
+      {input.b + at, first},
+      {input.b, free - first},
     };
+
+    ssize_t n = backend->read(iov, free > first ? 2 : 1);
+    if(n <= 0)
+      return 0;
+
+    if(recording != nullptr) {
+      std::string chunk;
+      for(ssize_t i = 0; i < n; i++)
+        chunk += input.b[(input.tail + i) & input_ring_mask];
+      fprintf(recording, "%s\n", script_line(chunk).c_str());
+      fflush(recording);
+    }
+
+    input.tail += n;
+    return n;
+
   }
-  
 
 
-  
+  void push_key(std::vector<key_event_t>& keys, char c, bool alt = false) {
+    key_event_t k;
+    k.type = alt ? key_event_t::ALT : key_event_t::CHAR;
+    k.c = c;
+    keys.push_back(std::move(k));
+  }
+
+
+  void push_paste(std::vector<key_event_t>& keys) {
+    if(input.paste.empty())
+      return;
+    key_event_t k;
+    k.type = key_event_t::PASTE;
+    k.text = std::move(input.paste);
+    input.paste.clear();
+    keys.push_back(std::move(k));
+  }
+
+
+  // turn a complete CSI / SS3 sequence body (params + final
+  // byte) into a key, or nothing if the editor has no use for it.
+  void decode_sequence(std::vector<key_event_t>& keys, const std::string& seq) {
+
+    if(seq == "200~") {
+      input.pasting = true;
+      return;
+    }
+
+    switch(seq.back()) {
+    case 'A': push_key(keys, 16); return; // up    -> C-p
+    case 'B': push_key(keys, 14); return; // down  -> C-n
+    case 'C': push_key(keys, 6);  return; // right -> C-f
+    case 'D': push_key(keys, 2);  return; // left  -> C-b
+    case 'H': push_key(keys, 1);  return; // home  -> C-a
+    case 'F': push_key(keys, 5);  return; // end   -> C-e
+    }
+
+    if(seq == "1~" || seq == "7~")
+      push_key(keys, 1);
+    else if(seq == "4~" || seq == "8~")
+      push_key(keys, 5);
+
+  }
+
+
+  /**
+     input_decode
+
+     take complete key events off the front of the ring.
+     Returns true when it stopped on a sequence that may still
+     be completed by the next read. With flush set nothing is
+     held back: a lone ESC is the escape key and a broken
+     sequence is dropped.
+   */
+  bool input_decode(std::vector<key_event_t>& keys, bool flush) {
+
+    while(input_pending() > 0) {
+
+      if(input.pasting) {
+        // copy up to the next ESC, which may be the end marker.
+        size_t n = 0;
+        while(n < input_pending() && input_at(n) != 27)
+          n++;
+        for(size_t i = 0; i < n; i++)
+          input.paste += input_at(i);
+        input.head += n;
+
+        if(input_pending() == 0)
+          break;
+
+        const char* end = "\x1b[201~";
+        size_t m = 0;
+        while(m < 6 && m < input_pending() && input_at(m) == end[m])
+          m++;
+
+        if(m == 6) {
+          input.head += 6;
+          input.pasting = false;
+          push_paste(keys);
+        } else if(m == input_pending() && !flush) {
+          return true;
+        } else {
+          input.paste += input_at(0);
+          input.head++;
+        }
+        continue;
+      }
+
+      const char c = input_at(0);
+
+      if(c != 27) {
+        push_key(keys, c);
+        input.head++;
+        continue;
+      }
+
+      if(input_pending() < 2) {
+        if(!flush)
+          return true;
+        push_key(keys, 27);
+        input.head++;
+        continue;
+      }
+
+      const char next = input_at(1);
+
+      if(next != '[' && next != 'O') {
+        push_key(keys, next, true);
+        input.head += 2;
+        continue;
+      }
+
+      // CSI / SS3: parameter bytes then one final byte in @..~
+      std::string seq;
+      size_t i = 2;
+      while(i < input_pending() && seq.size() < 32) {
+        const char b = input_at(i++);
+        seq += b;
+        if(b >= 0x40 && b <= 0x7e)
+          break;
+      }
+
+      const bool complete = !seq.empty() && seq.back() >= 0x40 && seq.back() <= 0x7e;
+
+      if(!complete && seq.size() < 32 && !flush)
+        return true;
+
+      input.head += i;
+      if(complete)
+        decode_sequence(keys, seq);
+
+    }
+
+    return false;
+
+  }
+
+
+  std::vector<key_event_t> read_keys() {
+
+    std::vector<key_event_t> keys;
+
+    input_fill(0);
+
+    while(true) {
+
+      if(input_decode(keys, false)) {
+        // the sequence may still be on its way.
+        if(input_fill(escape_timeout_ms) == 0)
+          input_decode(keys, true);
+        continue;
+      }
+
+      // keep going while more is already waiting, so a paste
+      // becomes one batch instead of a frame per read.
+      if(input_fill(0) == 0)
+        break;
+
+    }
+
+    // hand over what has been pasted so far, the rest follows.
+    push_paste(keys);
+
+    return keys;
+
+  }
+
+
+  /**
+     unread_keys
+
+     give back keys out of a batch that the reader didn't get
+     to, i.e. what was typed after the enter that closed a
+     prompt. The next wait_events() returns them, ahead of
+     anything read since, without waiting.
+   */
+  void unread_keys(std::vector<key_event_t> keys) {
+    input.unread.insert(input.unread.begin(),
+                        std::make_move_iterator(keys.begin()),
+                        std::make_move_iterator(keys.end()));
+  }
+
+
+  bool next_key(key_event_t& key) {
+    if(input.unread.empty())
+      return false;
+    key = std::move(input.unread.front());
+    input.unread.pop_front();
+    return true;
+  }
+
+
+  /**
+     wait_events
+
+     sleep until there is input, the terminal is resized or
+     timeout ms pass (-1 waits for ever), then report what
+     happened. Nothing runs while the editor is idle.
+   */
+  events_t wait_events(int timeout) {
+
+    events_t ev;
+
+    if(!input.unread.empty()) {
+      ev.keys.assign(std::make_move_iterator(input.unread.begin()),
+                     std::make_move_iterator(input.unread.end()));
+      input.unread.clear();
+    } else if(input_pending() > 0) {
+      // a sequence still waiting for its tail is decoded now.
+      ev.keys = read_keys();
+    } else {
+      const auto w = backend_wait(timeout);
+      if(w.input)
+        ev.keys = read_keys();
+      ev.closed = w.closed;
+    }
+
+    // also when it came up while reading keys.
+    if(input.resized) {
+      input.resized = false;
+      poll_terminal_size();
+      ev.resized = true;
+    }
+
+    return ev;
+
+  }
 
-  
 }
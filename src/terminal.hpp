@@ -4,8 +4,13 @@
 #include <iostream>
 #include <termios.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cstdint>
 #include <functional>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "gap_buffer.hpp"
 #include "file.hpp"
@@ -20,6 +25,81 @@ namespace terminal {
     size_t rows = 30;
     size_t cx, cy = 0;
   }terminal_meta_t;
+
+
+  // how lines are laid out on rows, see put_lines().
+  typedef struct render_mode {
+    bool wrap = true;    // long lines go on over more rows, or are cut at the edge
+    bool numbers = true; // the line number gutter
+  } render_mode_t;
+
+
+  /**
+     key_event
+
+     one decoded key press. Arrow, Home and End keys arrive
+     as the control characters of their emacs bindings
+     (C-p, C-n, C-f, C-b, C-a, C-e).
+   */
+  typedef struct key_event {
+    enum { CHAR, ALT, PASTE } type = CHAR;
+    char c = 0;       // the key, for CHAR and ALT
+    std::string text; // what was pasted, for PASTE
+  } key_event_t;
+
+
+  /**
+     Backend
+
+     where the terminal's bytes come from and go to. Decoding
+     keys and working out what changed on screen happen above
+     it, a backend only moves bytes: the tty the editor runs
+     in, or a script replayed with no terminal at all (see
+     Replay_Backend).
+   */
+  class Backend {
+  public:
+    typedef struct wake {
+      bool input = false;
+      bool resized = false;
+      bool closed = false; // no input will ever come
+    } wake_t;
+
+    virtual ~Backend() = default;
+
+    virtual void setup() = 0;
+    virtual void cleanup() = 0;
+
+    // sleep up to timeout ms (-1 for ever) until there is input or a resize.
+    virtual wake_t wait(int timeout) = 0;
+    virtual ssize_t read(const struct iovec* iov, int n) = 0; // what is waiting, 0 if nothing
+    virtual void write(const struct iovec* iov, int n) = 0;   // all of it
+    virtual std::pair<size_t, size_t> size() = 0;             // columns, rows
+
+    virtual void frame_begin() {} // the editor starts laying out a frame
+  };
+
+  // what the terminal has cost since the start, for diagnostics.
+  typedef struct io_stats {
+    uint64_t syscalls = 0;  // made by the tty backend
+    uint64_t bytes_out = 0; // written to the terminal
+    uint64_t wait_ns = 0;   // asleep in Backend::wait()
+  } io_stats_t;
+
+  const io_stats_t& io_stats();
+
+  // before setup_terminal(), the tty is used when never called.
+  void set_backend(Backend* b);
+  void record_input(const char* path); // append every read to a replay script
+  void frame_begin();
+
+
+  // what woke wait_events() up.
+  typedef struct events {
+    std::vector<key_event_t> keys;
+    bool resized = false;
+    bool closed = false; // stdin hung up
+  } events_t;
   
 
   void cleanup_terminal();
@@ -36,10 +116,18 @@ namespace terminal {
   void put_str(const char* c, int N);
   void put_line(const char* c, int N);
   void put_buffer(buffers::Gap_Buffer<GAP_BUFFER_SIZE>* gb);
-  void put_line_obj(files::Editor_File::Line* l); // same as put_buffer but with wrapping.
+  // lines [from, to) of f in the render mode, at most max_rows rows. Returns the lines drawn.
+  int put_lines(files::Editor_File* f, int from, int to, int max_rows);
+  int wrap_width(); // columns of text on a row, after the gutter. Huge when not wrapping
+  int gutter_width();
+  render_mode_t get_render_mode();
+  void set_render_mode(render_mode_t mode); // repaints everything
   std::pair<size_t, size_t> get_terminal_size();
   std::pair<size_t, size_t> get_cursor_location();
-  std::function<char()> get_input();
+  std::vector<key_event_t> read_keys(); // whatever is waiting, never blocks
+  void unread_keys(std::vector<key_event_t> keys); // wait_events() returns them first
+  bool next_key(key_event_t& key); // takes the oldest unread key, false if none
+  events_t wait_events(int timeout);
 
 
   }
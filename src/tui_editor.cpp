@@ -1,8 +1,15 @@
 #include "editor.hpp"
 #include "file.hpp"
+#include "regex.hpp"
 #include "terminal.hpp"
+#include "utf8.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <format>
+#include <memory>
 
 namespace editor {
 
@@ -14,24 +21,31 @@ namespace editor {
   }
 
 
-  // offset of other UI elements, i.e line numbers
-  // status bars.
-  const int x_offset = 5;
+  // offset of other UI elements, i.e status bars. Line
+  // numbers come and go, see terminal::gutter_width().
   const int y_offset = 1;
   const int y_offset_b = 1;
   
 
 
-  int wrapping_offset = 0;
+  // how often the line count is refreshed while indexing.
+  const int index_tick_ms = 100;
+
+  // unsaved edits go to the swap file once typing stops for this long.
+  const int autosave_delay_ms = 2000;
 
   // this function aims to sync the tui cursor and the editor cursor.
   // it queries the open_file cursor position and curent context.
   void TUI_Editor::sync_cursors() {
 
-    auto x = this->openFile->context->buf->getCursorPosition();
-    auto line = this->openFile->current_context_line - this->f->start_line_number;
-    
-    terminal::set_cursor_position(x + x_offset, line + y_offset + wrapping_offset);
+    // rows taken by the lines above, then the cursor's place
+    // in its own (maybe wrapped) line. All from cached metrics.
+    auto above = this->f->rows_between(this->f->start_line_number, this->openFile->current_context_line);
+    auto [row, x] = this->openFile->context->cursor_cell(terminal::wrap_width());
+
+    // unwrapped, a cursor past the right edge stays on the last column.
+    const int column = std::min<int>(x + terminal::gutter_width(), terminal::get_terminal_size().first);
+    terminal::set_cursor_position(column, above + row + y_offset);
     
     
   }
@@ -59,11 +73,11 @@ namespace editor {
 
 
   void TUI_Editor::home() {
-    this->openFile->context->buf->put_cursor_home();
+    this->openFile->context->move_cursor_to(0);
   }
 
   void TUI_Editor::end() {
-    this->openFile->context->buf->put_cursor_end();
+    this->openFile->context->move_cursor_to(this->openFile->context->length());
   }
   
 
@@ -77,95 +91,64 @@ namespace editor {
   
   void TUI_Editor::next_line() {
 
-    auto cpos = terminal::get_cursor_location();
-
-
-    if(cpos.second == terminal::get_terminal_size().second - 2)
-      return;
-
     if(!this->openFile->has_next()) {
       return;
     }
 
 
-    wrapping_offset += this->openFile->context->wrapping;
-    this->openFile->next_line();
+    auto column = this->openFile->context->cursor_position();
 
-    auto strlen = this->openFile->context->buf->strlen;
+    this->openFile->next_line();
 
-    
-    if(strlen < cpos.first) {
-      this->openFile->context->buf->put_cursor_end();
-    }
+    // keep the column, clamped to the end of the shorter line.
+    this->openFile->context->move_cursor_to(column);
 
     if(this->openFile->current_context_line == this->f->end_line_number - 1)
       f->scroll_down(1);
 
+    // a wrapped line can reach past the bottom before that.
+    this->f->show(this->openFile->current_context_line);
+
   }
 
 
   void TUI_Editor::prev_line() {
 
-    auto cpos = terminal::get_cursor_location();
-    wrapping_offset -= this->openFile->context->wrapping;
-    
+    auto column = this->openFile->context->cursor_position();
     this->openFile->prev_line();
 
-    auto strlen = this->openFile->context->buf->strlen;
-    
-    if(strlen < cpos.first) {
-      this->openFile->context->buf->put_cursor_end();
-    } else {
-      // put the cursor in the right column
-      for(int i = 0; i < cpos.first; i++) {
-        this->openFile->forward();
-      }
-      
-    }
+    // put the cursor in the right column
+    this->openFile->context->move_cursor_to(column);
 
     if(this->openFile->current_context_line == this->f->start_line_number && this->openFile->current_context_line != 0)
       this->f->scroll_up(1);
-    
+
   }
-  
-  void TUI_Editor::forward() {
 
-    auto strlen = this->openFile->context->buf->strlen;
-    auto cpos = terminal::get_cursor_location();
+  void TUI_Editor::forward() {
 
-    if(cpos.first < strlen) {
-      //terminal::set_cursor_position(cpos.first + 1, cpos.second);
-      this->openFile->forward();
-    }
+    // the file clamps to the end of the line, the screen column
+    // includes the gutter so it can't be compared to the length.
+    this->openFile->forward();
    
   }
   
   void TUI_Editor::backward() {
-    auto cpos = terminal::get_cursor_location();
-    //terminal::set_cursor_position(cpos.first - 1, cpos.second);
     this->openFile->backward();
   }
 
 
   void TUI_Editor::delete_char() {
-    auto cpos = terminal::get_cursor_location();
 
-    if(this->openFile->context->buf->getCursorPosition() > 0) {
-      //terminal::set_cursor_position(cpos.first - 1, cpos.second);
-      this->openFile->context->buf->free();
+    if(this->openFile->context->cursor_position() > 0) {
+      this->openFile->delete_char();
     } else {
       this->f->remove_line_hook();
       this->openFile->remove_line();
       this->f->scroll_up(1);
       this->sync_cursors();
-      
-
-      auto strlen = this->openFile->context->buf->strlen;
-      
-      //terminal::set_cursor_position(strlen, cpos.second - 1);
-      this->openFile->context->buf->put_cursor_end();
 
-      
+      // remove_line() leaves the cursor where the lines joined.
     }
    
   }
@@ -173,10 +156,10 @@ namespace editor {
 
  
   void TUI_Editor::new_line() {
-    auto cpos = terminal::get_cursor_location();
-    
+
     this->openFile->new_line();
     this->next_line();    
+    this->home(); // the split off text starts the new line
     this->f->new_line_hook(false);
 
     if(this->openFile->current_context_line >= this->f->size)
@@ -198,129 +181,490 @@ namespace editor {
       start += " "; 
     }
     start += reset;
+    start += "\r\n";
     terminal::put_str(start.c_str(), start.length());
     
   }
 
 
 
-  std::string TUI_Editor::get_user_input(std::string prompt) {
+  std::string TUI_Editor::get_user_input(std::string prompt, input_hook_t changed, const keymap_t* keys) {
 
+    std::string buf;
 
-    char* buf = new char[64];
-    int len = 0;
-    
-    auto get_char = terminal::get_input();
-
-    char cmd;
-    
     while(1) {
 
       draw();
 
       terminal::put_str(prompt.c_str(), prompt.length());
-      terminal::put_str(buf, len);
+      terminal::put_str(buf.c_str(), buf.length());
       terminal::draw_rows();
 
-      cmd = get_char();
-      
-      if(cmd == 13) {
-        break;
-      }
-      
-      if(cmd == 127 && len > 0) {
-        len--;
-        continue;
+      auto ev = terminal::wait_events(-1);
+      if(ev.closed)
+        return buf;
+
+      std::string before = buf;
+
+      // once per batch, typing fast doesn't queue up work. Also
+      // before anything that acts on the text typed so far.
+      auto settle = [&]() {
+        if(changed && buf != before)
+          changed(buf);
+        before = buf;
+      };
+
+      for(size_t i = 0; i < ev.keys.size(); i++) {
+
+        const auto& key = ev.keys[i];
+
+        if(key.type == terminal::key_event_t::PASTE) {
+          buf += key.text;
+          continue;
+        }
+
+        if(key.type != terminal::key_event_t::CHAR)
+          continue;
+
+        // the caller's keys come first.
+        if(keys != nullptr && keys->contains(key.c)) {
+          settle();
+          keys->at(key.c)();
+          continue;
+        }
+
+        // what was typed after enter isn't the prompt's.
+        if(key.c == 13) {
+          settle();
+          terminal::unread_keys({ev.keys.begin() + i + 1, ev.keys.end()});
+          return buf;
+        }
+
+        if(key.c == 127) {
+          buf.resize(buf.size() - files::prev_char_length(buf, buf.size()));
+          continue;
+        }
+
+        if(key.c != 0)
+          buf += key.c;
       }
 
-      if(cmd != 0) {
-        buf[len] = cmd;
-        len++;
-      }
-      
+      settle();
+
     }
 
-    
-    
-    return std::string(buf, buf+len);
-    
   }
   
 
 
+  void TUI_Editor::set_render_mode(terminal::render_mode_t mode) {
+    terminal::set_render_mode(mode);
+
+    // rows per line change with wrapping.
+    if(this->f != nullptr)
+      this->f->show(this->openFile->current_context_line);
+  }
+
+
   void TUI_Editor::draw() {
-    terminal::clear_terminal();
+    terminal::frame_begin();
+
+    // no clear, draw_rows() only sends the rows that changed.
     put_modline(mod_line);
-    f->display();      
+
+    // prompts can come up before the first file is open.
+    if(this->f == nullptr)
+      return;
+
+    {
+      Diagnostics::Scope s(this->diag, Diagnostics::DISPLAY);
+      f->display();
+    }
     this->sync_cursors();
   }
 
 
+  // apply one key, false when it asks to quit.
+  bool TUI_Editor::handle_char(char c) {
+
+    // consult keymap
+    if(this->keymap.contains(c)) {
+      this->keymap[c]();
+      return true;
+    }
+           
+
+    // tab
+    if(c == 9) {
+      this->openFile->write_char(' ');
+      this->openFile->write_char(' ');
+      this->openFile->write_char(' ');
+      this->openFile->write_char(' ');
+      return true;
+    }
+      
+    if(c == 17) {
+      return false;
+    }
+
+
+    // bytes of UTF-8 characters come one key each.
+    if(static_cast<unsigned char>(c) >= 32 && c != 127) {
+      this->openFile->write_char(c); // write a character to the buffer
+    }
+
+    return true;
+
+  }
+
+
+  /**
+     paste
+
+     a pasted block goes into the file in one insert rather
+     than a key at a time. Line breaks become \n and tabs
+     become spaces, as if typed. The frame then moves once
+     to keep the cursor in view.
+   */
+  void TUI_Editor::paste(const std::string& text) {
+
+    std::string block;
+    block.reserve(text.size());
+
+    for(size_t i = 0; i < text.size(); i++) {
+      const char c = text[i];
+      if(c == '\r') {
+        if(i + 1 < text.size() && text[i + 1] == '\n')
+          continue;
+        block += '\n';
+      } else if(c == '\t') {
+        block += "    ";
+      } else {
+        block += c;
+      }
+    }
+
+    const size_t added = this->openFile->insert_text(block.data(), block.size());
+
+    if(added > 0)
+      this->f->show(this->openFile->current_context_line);
+
+  }
+
+
+  void TUI_Editor::undo() {
+    if(this->openFile->undo())
+      this->f->show(this->openFile->current_context_line);
+    else
+      this->put_status_line("Nothing to undo");
+  }
+
+
+  void TUI_Editor::redo() {
+    if(this->openFile->redo())
+      this->f->show(this->openFile->current_context_line);
+    else
+      this->put_status_line("Nothing to redo");
+  }
+
+
+  /**
+     go_to
+
+     jump straight to a line (numbered as in the gutter) or a
+     byte offset. Both are found in the line tree in O(log n),
+     the frame is then placed around the target rather than
+     scrolled there. A target past what the background index
+     has reached waits for it to finish.
+   */
+  void TUI_Editor::go_to(bool offset) {
+
+    auto file = this->openFile;
+    auto input = this->get_user_input(offset ? "Go to offset: " : "Go to line: ");
+    if(input.empty())
+      return;
+
+    uint64_t n;
+    auto [end, err] = std::from_chars(input.data(), input.data() + input.size(), n);
+    if(err != std::errc() || end != input.data() + input.size()) {
+      this->put_status_line("Not a number: " + input);
+      return;
+    }
+
+    if(offset) {
+      if(file->indexing() && n >= file->line_tree.bytes())
+        while(!file->poll_index(true));
+      file->goto_offset(n);
+    } else {
+      if(file->indexing() && n >= file->lines)
+        while(!file->poll_index(true));
+      file->goto_line(n);
+      file->context->move_cursor_to(0);
+    }
+
+    this->f->center(file->current_context_line);
+
+  }
+
+
+  /**
+     search
+
+     incremental search through the prompt. Every change to
+     the text jumps to the first match from where the search
+     started, ctrl-w / ctrl-r step to the next or previous
+     match (wrapping round). With regex the text is compiled
+     as it is typed, while it doesn't parse nothing moves.
+   */
+  void TUI_Editor::search(bool forward, bool regex) {
+
+    auto file = this->openFile;
+    const uint64_t origin = file->cursor_offset();
+
+    std::string needle;
+    uint64_t match = origin;
+    bool found = false;
+
+    files::Regex re;
+    std::unique_ptr<files::Matcher> matcher;
+
+    auto jump = [&](uint64_t at) {
+      file->goto_offset(at);
+      this->f->show(file->current_context_line);
+    };
+
+    auto find = [&](uint64_t from, bool fwd, uint64_t& at) {
+      size_t length;
+      if(regex)
+        return matcher && file->find_regex(*matcher, from, fwd, at, length);
+      return file->find(needle, from, fwd, at);
+    };
+
+    auto look = [&](uint64_t from, bool fwd) {
+      uint64_t at;
+      found = find(from, fwd, at) || find(fwd ? 0 : UINT64_MAX, fwd, at);
+
+      if(found) {
+        match = at;
+        jump(at);
+      }
+    };
+
+    keymap_t keys;
+    keys[23] = [&]() {
+      if(!needle.empty())
+        look(found ? match + 1 : origin, true);
+    };
+    keys[18] = [&]() {
+      if(!needle.empty())
+        look(found ? match : origin, false);
+    };
+
+    auto prompt = regex ? (forward ? "Regex search: " : "Regex search backward: ")
+      : (forward ? "Search: " : "Search backward: ");
+
+    this->get_user_input(prompt, [&](const std::string& text) {
+      needle = text;
+      found = false;
+
+      if(regex) {
+        matcher.reset();
+        if(re.compile(needle))
+          matcher = std::make_unique<files::Matcher>(&re);
+      }
+
+      if(needle.empty()) {
+        jump(origin);
+        return;
+      }
+
+      look(origin, forward);
+    }, &keys);
+
+    if(!needle.empty() && !found) {
+      jump(origin);
+      if(regex && !re.error.empty())
+        this->put_status_line("Bad regex: " + re.error);
+      else
+        this->put_status_line("Not found: " + needle);
+    }
+
+  }
+
+
+  void TUI_Editor::replace_all() {
+
+    auto pattern = this->get_user_input("Replace (regex): ");
+    if(pattern.empty())
+      return;
+
+    files::Regex re;
+    if(!re.compile(pattern)) {
+      this->put_status_line("Bad regex: " + re.error);
+      return;
+    }
+
+    auto with = this->get_user_input("With: ");
+
+    const auto n = this->openFile->replace_all(re, with);
+    this->f->show(this->openFile->current_context_line);
+    this->put_status_line("Replaced " + std::to_string(n) + (n == 1 ? " match" : " matches"));
+
+  }
+
+
+  bool TUI_Editor::handle_key(const terminal::key_event_t& key) {
+
+    switch(key.type) {
+
+    case terminal::key_event_t::ALT:
+      if(this->alt_keymap.contains(key.c))
+        this->alt_keymap[key.c]();
+      return true;
+
+    case terminal::key_event_t::PASTE:
+      this->paste(key.text);
+      return true;
+
+    default:
+      return this->handle_char(key.c);
+    }
+
+  }
+
   
   
   void TUI_Editor::run() {
 
-    auto get_char = terminal::get_input();
-
     auto rows = terminal::get_terminal_size().second - 3;
        
-    this->f = new Frame(this->openFile->head, rows, 0);
+    this->f = new Frame(this->openFile, rows, 0);
 
+    bool dirty = true;
+    auto last_key = std::chrono::steady_clock::now();
     
     while (1) {
-      terminal::poll_terminal_size();
-      draw();
-      terminal::put_str(this->status_line.c_str(), this->status_line.length());
 
-      if(!status_persist)
-        this->status_line = "";
-      
-      terminal::draw_rows();
-      
-      char c = get_char();
-
-
-      this->mod_line = "";
-      int k = 1;
-      for(const auto& [key, value] : this->Files) {
+      if(dirty) {
+        this->mod_line = "";
+        int k = 1;
+        for(const auto& [key, value] : this->Files) {
         
-        //        if(key == this->openFile->filename)
-        //  this->mod_line += "\033[0m\033[37;41m";
+          //        if(key == this->openFile->filename)
+          //  this->mod_line += "\033[0m\033[37;41m";
         
-        this->mod_line += std::format(" [{:02}]{}", k, key);
+          this->mod_line += std::format(" [{:02}]{}", k, key);
 
-        //if(key == this->openFile->filename)
-        //  this->mod_line += "\033[0m\033[37;44m"; 
+          //if(key == this->openFile->filename)
+          //  this->mod_line += "\033[0m\033[37;44m"; 
         
-        k++;
+          k++;
+        }
+
+        this->mod_line += std::format(" {}{} lines", this->openFile->lines,
+                                      this->openFile->indexing() ? "+" : "");
+
+        // messages win over the diagnostics overlay.
+        const auto status = this->status_line.empty() && this->diag.overlay
+          ? this->diag.summary() : this->status_line;
+
+        {
+          Diagnostics::Scope s(this->diag, Diagnostics::DRAW);
+          draw();
+          terminal::put_str(status.c_str(), status.length());
+        }
+
+        if(!status_persist)
+          this->status_line = "";
+      
+        {
+          Diagnostics::Scope s(this->diag, Diagnostics::DRAW_ROWS);
+          terminal::draw_rows();
+        }
+        this->diag.frame_done();
+        dirty = false;
       }
-                 
-      // consult keymap
-      if(this->keymap.contains(c)) {
-        this->keymap[c]();
-        continue;
+
+
+      // sleep until a key, a resize or, while a big file is
+      // still being indexed or has edits not yet autosaved, the
+      // next tick.
+      bool indexing = false;
+      for(const auto& [name, file] : this->Files)
+        indexing |= file->indexing();
+
+      int timeout = indexing ? index_tick_ms : -1;
+
+      bool unsaved = false;
+      for(const auto& [name, file] : this->Files)
+        unsaved |= file->needs_autosave();
+
+      if(unsaved) {
+        auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - last_key).count();
+        int left = idle < autosave_delay_ms ? autosave_delay_ms - idle : 0;
+
+        if(left == 0) {
+          // snapshots are written on the autosaver's thread.
+          for(const auto& [name, file] : this->Files)
+            file->autosave();
+          left = -1;
+        }
+
+        if(left >= 0 && (timeout < 0 || left < timeout))
+          timeout = left;
       }
-           
 
-      // tab
-      if(c == 9) {
-        this->openFile->write_char(' ');
-        this->openFile->write_char(' ');
-        this->openFile->write_char(' ');
-        this->openFile->write_char(' ');
-        continue;
+      const auto woke = std::chrono::steady_clock::now();
+      const auto slept = terminal::io_stats().wait_ns;
+
+      auto ev = terminal::wait_events(timeout);
+
+      // the time it took to take the keys in, not to wait for them.
+      if(this->diag.active()) {
+        const uint64_t total = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - woke).count();
+        const uint64_t asleep = terminal::io_stats().wait_ns - slept;
+        const uint64_t ns = total > asleep ? total - asleep : 0;
+        this->diag.add(Diagnostics::INPUT, woke + std::chrono::nanoseconds(total - ns), ns);
       }
-      
-      if(c == 17) {
-        break;
+
+      if(ev.closed)
+        return;
+
+      if(ev.resized)
+        dirty = true;
+
+      // the line count fills in while a big file is still being
+      // indexed, also for the ones in the background: nobody
+      // else collects their chunks.
+      if(indexing) {
+        for(const auto& [name, file] : this->Files)
+          if(file->indexing())
+            file->poll_index();
+        dirty = true;
       }
 
+      // everything that arrived since the last frame is applied
+      // before drawing the next one.
+      Diagnostics::Scope s(this->diag, Diagnostics::DISPATCH);
+      this->diag.keys(ev.keys.size());
 
-      if(c != 0 && c >= 32 && c <= 126) {
-        
-        this->openFile->write_char(c); // write a character to the buffer
-        auto cpos = terminal::get_cursor_location(); // advance the cursor
-        
+      if(!ev.keys.empty())
+        last_key = std::chrono::steady_clock::now();
+
+      // the batch is taken one key at a time from the terminal,
+      // so a key that opens a prompt leaves the rest to it and
+      // gets back whatever came after its enter.
+      terminal::unread_keys(std::move(ev.keys));
+
+      for(terminal::key_event_t key; terminal::next_key(key); ) {
+        if(!this->handle_key(key))
+          return;
+
+        // the cursor decides where the next key lands.
+        this->sync_cursors();
+        dirty = true;
       }
       
     }
@@ -333,7 +677,15 @@ namespace editor {
     Editor::open_file(path);
     auto rows = terminal::get_terminal_size().second - 3;
     delete this->f;
-    this->f = new Frame(this->openFile->head, rows, 0);
+    this->f = new Frame(this->openFile, rows, 0);
+  }
+
+
+  void TUI_Editor::close_file() {
+    // draw() skips the text without a frame.
+    delete this->f;
+    this->f = nullptr;
+    Editor::close_file();
   }
 
 
@@ -341,7 +693,7 @@ namespace editor {
     Editor::switch_buffer(index);
     auto rows = terminal::get_terminal_size().second - 3;
     delete this->f;
-    this->f = new Frame(this->openFile->head, rows, 0);
+    this->f = new Frame(this->openFile, rows, 0);
   }
   
   
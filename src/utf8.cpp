@@ -0,0 +1,394 @@
+#include "utf8.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace files {
+
+
+  size_t decode_utf8(const char* s, size_t n, uint32_t& cp) {
+
+    const auto u = reinterpret_cast<const unsigned char*>(s);
+    const uint32_t c = u[0];
+
+    if(c < 0x80) {
+      cp = c;
+      return 1;
+    }
+
+    // length from the lead byte, and the smallest code point
+    // that needs it: anything under is an overlong encoding.
+    size_t len;
+    uint32_t min;
+    if((c & 0xe0) == 0xc0) {
+      len = 2, min = 0x80, cp = c & 0x1f;
+    } else if((c & 0xf0) == 0xe0) {
+      len = 3, min = 0x800, cp = c & 0x0f;
+    } else if((c & 0xf8) == 0xf0) {
+      len = 4, min = 0x10000, cp = c & 0x07;
+    } else {
+      cp = 0xfffd;
+      return 1;
+    }
+
+    if(len > n) {
+      cp = 0xfffd;
+      return 1;
+    }
+
+    for(size_t i = 1; i < len; i++) {
+      if(!is_continuation(s[i])) {
+        cp = 0xfffd;
+        return 1;
+      }
+      cp = (cp << 6) | (u[i] & 0x3f);
+    }
+
+    if(cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+      cp = 0xfffd;
+      return 1;
+    }
+
+    return len;
+
+  }
+
+
+  /**
+     widths other than one column, as [first, last] ranges,
+     after the tables wcwidth implementations use.
+   */
+  typedef struct range {
+    uint32_t first;
+    uint32_t last;
+  } range_t;
+
+  static const range_t zero_width[] = {
+    {0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x05bf, 0x05bf},
+    {0x05c1, 0x05c2}, {0x05c4, 0x05c5}, {0x05c7, 0x05c7}, {0x0610, 0x061a},
+    {0x064b, 0x065f}, {0x0670, 0x0670}, {0x06d6, 0x06dc}, {0x06df, 0x06e4},
+    {0x06e7, 0x06e8}, {0x06ea, 0x06ed}, {0x0711, 0x0711}, {0x0730, 0x074a},
+    {0x07a6, 0x07b0}, {0x07eb, 0x07f3}, {0x0816, 0x0819}, {0x081b, 0x0823},
+    {0x0825, 0x0827}, {0x0829, 0x082d}, {0x0859, 0x085b}, {0x08d3, 0x08e1},
+    {0x08e3, 0x0902}, {0x093a, 0x093a}, {0x093c, 0x093c}, {0x0941, 0x0948},
+    {0x094d, 0x094d}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0981},
+    {0x09bc, 0x09bc}, {0x09c1, 0x09c4}, {0x09cd, 0x09cd}, {0x09e2, 0x09e3},
+    {0x0a01, 0x0a02}, {0x0a3c, 0x0a3c}, {0x0a41, 0x0a42}, {0x0a47, 0x0a48},
+    {0x0a4b, 0x0a4d}, {0x0a51, 0x0a51}, {0x0a70, 0x0a71}, {0x0a75, 0x0a75},
+    {0x0a81, 0x0a82}, {0x0abc, 0x0abc}, {0x0ac1, 0x0ac5}, {0x0ac7, 0x0ac8},
+    {0x0acd, 0x0acd}, {0x0ae2, 0x0ae3}, {0x0b01, 0x0b01}, {0x0b3c, 0x0b3c},
+    {0x0b3f, 0x0b3f}, {0x0b41, 0x0b44}, {0x0b4d, 0x0b4d}, {0x0b56, 0x0b56},
+    {0x0b62, 0x0b63}, {0x0b82, 0x0b82}, {0x0bc0, 0x0bc0}, {0x0bcd, 0x0bcd},
+    {0x0c00, 0x0c00}, {0x0c3e, 0x0c40}, {0x0c46, 0x0c48}, {0x0c4a, 0x0c4d},
+    {0x0c55, 0x0c56}, {0x0c62, 0x0c63}, {0x0cbc, 0x0cbc}, {0x0cbf, 0x0cbf},
+    {0x0cc6, 0x0cc6}, {0x0ccc, 0x0ccd}, {0x0ce2, 0x0ce3}, {0x0d00, 0x0d01},
+    {0x0d41, 0x0d44}, {0x0d4d, 0x0d4d}, {0x0d62, 0x0d63}, {0x0dca, 0x0dca},
+    {0x0dd2, 0x0dd4}, {0x0dd6, 0x0dd6}, {0x0e31, 0x0e31}, {0x0e34, 0x0e3a},
+    {0x0e47, 0x0e4e}, {0x0eb1, 0x0eb1}, {0x0eb4, 0x0ebc}, {0x0ec8, 0x0ecd},
+    {0x0f18, 0x0f19}, {0x0f35, 0x0f35}, {0x0f37, 0x0f37}, {0x0f39, 0x0f39},
+    {0x0f71, 0x0f7e}, {0x0f80, 0x0f84}, {0x0f86, 0x0f87}, {0x0f8d, 0x0fbc},
+    {0x0fc6, 0x0fc6}, {0x102d, 0x1030}, {0x1032, 0x1037}, {0x1039, 0x103a},
+    {0x103d, 0x103e}, {0x1058, 0x1059}, {0x105e, 0x1060}, {0x1071, 0x1074},
+    {0x1082, 0x1082}, {0x1085, 0x1086}, {0x108d, 0x108d}, {0x109d, 0x109d},
+    {0x1160, 0x11ff}, {0x135d, 0x135f}, {0x1712, 0x1714}, {0x1732, 0x1734},
+    {0x1752, 0x1753}, {0x1772, 0x1773}, {0x17b4, 0x17b5}, {0x17b7, 0x17bd},
+    {0x17c6, 0x17c6}, {0x17c9, 0x17d3}, {0x17dd, 0x17dd}, {0x180b, 0x180d},
+    {0x1885, 0x1886}, {0x18a9, 0x18a9}, {0x1920, 0x1922}, {0x1927, 0x1928},
+    {0x1932, 0x1932}, {0x1939, 0x193b}, {0x1a17, 0x1a18}, {0x1a1b, 0x1a1b},
+    {0x1a56, 0x1a56}, {0x1a58, 0x1a5e}, {0x1a60, 0x1a60}, {0x1a62, 0x1a62},
+    {0x1a65, 0x1a6c}, {0x1a73, 0x1a7c}, {0x1a7f, 0x1a7f}, {0x1ab0, 0x1aff},
+    {0x1b00, 0x1b03}, {0x1b34, 0x1b34}, {0x1b36, 0x1b3a}, {0x1b3c, 0x1b3c},
+    {0x1b42, 0x1b42}, {0x1b6b, 0x1b73}, {0x1b80, 0x1b81}, {0x1ba2, 0x1ba5},
+    {0x1ba8, 0x1ba9}, {0x1bab, 0x1bad}, {0x1be6, 0x1be6}, {0x1be8, 0x1be9},
+    {0x1bed, 0x1bed}, {0x1bef, 0x1bf1}, {0x1c2c, 0x1c33}, {0x1c36, 0x1c37},
+    {0x1cd0, 0x1cd2}, {0x1cd4, 0x1ce0}, {0x1ce2, 0x1ce8}, {0x1ced, 0x1ced},
+    {0x1cf4, 0x1cf4}, {0x1cf8, 0x1cf9}, {0x1dc0, 0x1dff}, {0x200b, 0x200f},
+    {0x202a, 0x202e}, {0x2060, 0x2064}, {0x20d0, 0x20f0}, {0x2cef, 0x2cf1},
+    {0x2d7f, 0x2d7f}, {0x2de0, 0x2dff}, {0x302a, 0x302d}, {0x3099, 0x309a},
+    {0xa66f, 0xa672}, {0xa674, 0xa67d}, {0xa69e, 0xa69f}, {0xa6f0, 0xa6f1},
+    {0xa802, 0xa802}, {0xa806, 0xa806}, {0xa80b, 0xa80b}, {0xa825, 0xa826},
+    {0xa8c4, 0xa8c5}, {0xa8e0, 0xa8f1}, {0xa8ff, 0xa8ff}, {0xa926, 0xa92d},
+    {0xa947, 0xa951}, {0xa980, 0xa982}, {0xa9b3, 0xa9b3}, {0xa9b6, 0xa9b9},
+    {0xa9bc, 0xa9bd}, {0xa9e5, 0xa9e5}, {0xaa29, 0xaa2e}, {0xaa31, 0xaa32},
+    {0xaa35, 0xaa36}, {0xaa43, 0xaa43}, {0xaa4c, 0xaa4c}, {0xaa7c, 0xaa7c},
+    {0xaab0, 0xaab0}, {0xaab2, 0xaab4}, {0xaab7, 0xaab8}, {0xaabe, 0xaabf},
+    {0xaac1, 0xaac1}, {0xaaec, 0xaaed}, {0xaaf6, 0xaaf6}, {0xabe5, 0xabe5},
+    {0xabe8, 0xabe8}, {0xabed, 0xabed}, {0xd7b0, 0xd7ff}, {0xfb1e, 0xfb1e},
+    {0xfe00, 0xfe0f}, {0xfe20, 0xfe2f}, {0xfeff, 0xfeff}, {0xfff9, 0xfffb},
+    {0x101fd, 0x101fd}, {0x102e0, 0x102e0}, {0x10376, 0x1037a}, {0x10a01, 0x10a0f},
+    {0x10a38, 0x10a3f}, {0x11001, 0x11001}, {0x11038, 0x11046}, {0x1107f, 0x11081},
+    {0x110b3, 0x110b6}, {0x110b9, 0x110ba}, {0x11100, 0x11102}, {0x11127, 0x1112b},
+    {0x1112d, 0x11134}, {0x1d167, 0x1d169}, {0x1d17b, 0x1d182}, {0x1d185, 0x1d18b},
+    {0x1d1aa, 0x1d1ad}, {0x1e000, 0x1e02a}, {0x1e8d0, 0x1e8d6}, {0x1e944, 0x1e94a},
+    {0xe0001, 0xe0001}, {0xe0020, 0xe007f}, {0xe0100, 0xe01ef},
+  };
+
+  static const range_t double_width[] = {
+    {0x1100, 0x115f}, {0x231a, 0x231b}, {0x2329, 0x232a}, {0x23e9, 0x23ec},
+    {0x23f0, 0x23f0}, {0x23f3, 0x23f3}, {0x25fd, 0x25fe}, {0x2614, 0x2615},
+    {0x2648, 0x2653}, {0x267f, 0x267f}, {0x2693, 0x2693}, {0x26a1, 0x26a1},
+    {0x26aa, 0x26ab}, {0x26bd, 0x26be}, {0x26c4, 0x26c5}, {0x26ce, 0x26ce},
+    {0x26d4, 0x26d4}, {0x26ea, 0x26ea}, {0x26f2, 0x26f3}, {0x26f5, 0x26f5},
+    {0x26fa, 0x26fa}, {0x26fd, 0x26fd}, {0x2705, 0x2705}, {0x270a, 0x270b},
+    {0x2728, 0x2728}, {0x274c, 0x274c}, {0x274e, 0x274e}, {0x2753, 0x2755},
+    {0x2757, 0x2757}, {0x2795, 0x2797}, {0x27b0, 0x27b0}, {0x27bf, 0x27bf},
+    {0x2b1b, 0x2b1c}, {0x2b50, 0x2b50}, {0x2b55, 0x2b55}, {0x2e80, 0x3029},
+    {0x302e, 0x303e}, {0x3041, 0x3098}, {0x309b, 0x33ff}, {0x3400, 0x4dbf},
+    {0x4e00, 0x9fff}, {0xa000, 0xa4cf}, {0xa960, 0xa97f}, {0xac00, 0xd7a3},
+    {0xf900, 0xfaff}, {0xfe10, 0xfe19}, {0xfe30, 0xfe6f}, {0xff00, 0xff60},
+    {0xffe0, 0xffe6}, {0x16fe0, 0x16fe4}, {0x17000, 0x187f7}, {0x18800, 0x18cd5},
+    {0x1b000, 0x1b2fb}, {0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf}, {0x1f18e, 0x1f18e},
+    {0x1f191, 0x1f19a}, {0x1f200, 0x1f202}, {0x1f210, 0x1f23b}, {0x1f240, 0x1f248},
+    {0x1f250, 0x1f251}, {0x1f260, 0x1f265}, {0x1f300, 0x1f320}, {0x1f32d, 0x1f335},
+    {0x1f337, 0x1f37c}, {0x1f37e, 0x1f393}, {0x1f3a0, 0x1f3ca}, {0x1f3cf, 0x1f3d3},
+    {0x1f3e0, 0x1f3f0}, {0x1f3f4, 0x1f3f4}, {0x1f3f8, 0x1f43e}, {0x1f440, 0x1f440},
+    {0x1f442, 0x1f4fc}, {0x1f4ff, 0x1f53d}, {0x1f54b, 0x1f54e}, {0x1f550, 0x1f567},
+    {0x1f57a, 0x1f57a}, {0x1f595, 0x1f596}, {0x1f5a4, 0x1f5a4}, {0x1f5fb, 0x1f64f},
+    {0x1f680, 0x1f6c5}, {0x1f6cc, 0x1f6cc}, {0x1f6d0, 0x1f6d2}, {0x1f6d5, 0x1f6d7},
+    {0x1f6eb, 0x1f6ec}, {0x1f6f4, 0x1f6fc}, {0x1f7e0, 0x1f7eb}, {0x1f90c, 0x1f93a},
+    {0x1f93c, 0x1f945}, {0x1f947, 0x1f9ff}, {0x1fa70, 0x1faff}, {0x20000, 0x2fffd},
+    {0x30000, 0x3fffd},
+  };
+
+
+  /**
+     Width_Table
+
+       stage1[cp >> 8] ──> blocks[i]: 256 widths, 2 bits each
+                                      (8 x 64 bit words)
+
+     17 * 256 top entries and around a hundred distinct blocks,
+     about 10 KiB where a flat table would be over a megabyte.
+   */
+  struct Width_Table {
+    typedef std::array<uint64_t, 8> block_t;
+
+    uint16_t stage1[0x110000 >> 8];
+    std::vector<block_t> blocks;
+
+    Width_Table() {
+
+      // painted flat once, then folded into blocks.
+      std::vector<uint8_t> w(0x110000, 1);
+      for(auto r : zero_width)
+        memset(&w[r.first], 0, r.last - r.first + 1);
+      for(auto r : double_width)
+        memset(&w[r.first], 2, r.last - r.first + 1);
+
+      for(uint32_t top = 0; top < (0x110000 >> 8); top++) {
+        block_t b = {};
+        for(uint32_t i = 0; i < 256; i++)
+          b[i >> 5] |= uint64_t(w[(top << 8) | i]) << ((i & 31) * 2);
+
+        size_t k = 0;
+        while(k < this->blocks.size() && this->blocks[k] != b)
+          k++;
+        if(k == this->blocks.size())
+          this->blocks.push_back(b);
+
+        this->stage1[top] = k;
+      }
+
+    }
+
+    int width(uint32_t cp) const {
+      const auto& b = this->blocks[this->stage1[cp >> 8]];
+      return (b[(cp & 0xff) >> 5] >> ((cp & 31) * 2)) & 3;
+    }
+  };
+
+
+  int char_width(uint32_t cp) {
+    static const Width_Table table;
+
+    if(cp < 0x300)
+      return 1;
+    if(cp > 0x10ffff)
+      return 1;
+
+    return table.width(cp);
+  }
+
+
+  static bool is_ascii_scalar(const char* s, size_t n) {
+
+    // eight bytes at a time, then the tail.
+    size_t i = 0;
+    uint64_t any = 0;
+    for(; i + 8 <= n; i += 8) {
+      uint64_t v;
+      memcpy(&v, s + i, 8);
+      any |= v;
+    }
+    for(; i < n; i++)
+      any |= static_cast<unsigned char>(s[i]);
+
+    return (any & 0x8080808080808080ull) == 0;
+
+  }
+
+
+#ifdef UTF8_X86
+
+  // the high bit of every byte, gathered by movemask.
+
+  __attribute__((target("sse2")))
+  static bool is_ascii_sse2(const char* s, size_t n) {
+    size_t i = 0;
+    __m128i any = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16)
+      any = _mm_or_si128(any, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+    return _mm_movemask_epi8(any) == 0 && is_ascii_scalar(s + i, n - i);
+  }
+
+
+  __attribute__((target("avx2")))
+  static bool is_ascii_avx2(const char* s, size_t n) {
+    size_t i = 0;
+    __m256i any = _mm256_setzero_si256();
+    for(; i + 32 <= n; i += 32)
+      any = _mm256_or_si256(any, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)));
+    return _mm256_movemask_epi8(any) == 0 && is_ascii_scalar(s + i, n - i);
+  }
+
+
+  // bytes from i that are all ASCII, a block at a time.
+  __attribute__((target("sse2")))
+  static size_t ascii_run_sse2(const char* s, size_t n, size_t i) {
+    for(; i + 16 <= n; i += 16) {
+      const int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+      if(mask != 0)
+        return i + __builtin_ctz(mask);
+    }
+    return i;
+  }
+
+#endif
+
+
+  bool is_ascii(Scan_Kernel k, std::string_view s) {
+    switch(k) {
+#ifdef UTF8_X86
+    case Scan_Kernel::avx2:
+      return is_ascii_avx2(s.data(), s.size());
+    case Scan_Kernel::sse2:
+      return is_ascii_sse2(s.data(), s.size());
+#endif
+    default:
+      return is_ascii_scalar(s.data(), s.size());
+    }
+  }
+
+
+  bool is_ascii(std::string_view s) {
+    static const Scan_Kernel k = best_scan_kernel();
+    return is_ascii(k, s);
+  }
+
+
+  /**
+     valid_utf8
+
+     ASCII stretches are skipped sixteen bytes at a time, only
+     what is left is decoded one character after another.
+   */
+  bool valid_utf8(std::string_view s) {
+
+#ifdef UTF8_X86
+    static const bool vector = scan_kernel_supported(Scan_Kernel::sse2);
+#endif
+
+    const char* p = s.data();
+    const size_t n = s.size();
+    size_t i = 0;
+
+    while(i < n) {
+#ifdef UTF8_X86
+      if(vector)
+        i = ascii_run_sse2(p, n, i);
+#endif
+      while(i < n && static_cast<unsigned char>(p[i]) < 0x80)
+        i++;
+      if(i == n)
+        break;
+
+      uint32_t cp;
+      const size_t len = decode_utf8(p + i, n - i, cp);
+      if(cp == 0xfffd && len == 1)
+        return false;
+      i += len;
+    }
+
+    return true;
+
+  }
+
+
+  size_t decode_utf8(std::string_view a, std::string_view b, size_t i, uint32_t& cp) {
+
+    if(i >= a.size())
+      return decode_utf8(b.data() + i - a.size(), b.size() - (i - a.size()), cp);
+
+    const size_t left = a.size() - i;
+    if(left >= 4 || b.empty())
+      return decode_utf8(a.data() + i, left, cp);
+
+    char seam[4];
+    const size_t n = std::min<size_t>(4, left + b.size());
+    memcpy(seam, a.data() + i, left);
+    memcpy(seam + left, b.data(), n - left);
+    return decode_utf8(seam, n, cp);
+
+  }
+
+
+  // the character the gap cuts, if any, is checked whole.
+  bool valid_utf8(std::string_view a, std::string_view b) {
+
+    size_t head = 0;
+    while(head < b.size() && head < 3 && is_continuation(b[head]))
+      head++;
+
+    if(head == 0)
+      return valid_utf8(a) && valid_utf8(b);
+
+    const size_t tail = prev_char_length(a, a.size());
+    std::string seam(a.substr(a.size() - tail));
+    seam += b.substr(0, head);
+
+    return valid_utf8(a.substr(0, a.size() - tail)) && valid_utf8(seam) && valid_utf8(b.substr(head));
+
+  }
+
+
+  size_t next_char_length(std::string_view s, size_t i) {
+    if(i >= s.size())
+      return 0;
+
+    size_t n = 1;
+    while(i + n < s.size() && n < 4 && is_continuation(s[i + n]))
+      n++;
+    return n;
+  }
+
+
+  size_t prev_char_length(std::string_view s, size_t i) {
+    if(i == 0)
+      return 0;
+
+    size_t n = 1;
+    while(n < i && n < 4 && is_continuation(s[i - n]))
+      n++;
+    return n;
+  }
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "line_index.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+namespace files {
+
+  /**
+
+     UTF-8
+
+     Text is kept as bytes, these say where the characters in
+     them start and how many columns each takes on screen:
+
+       'a'       1 column
+       'é'       1 column,  2 bytes
+       '漢'      2 columns, 3 bytes (East Asian wide)
+       U+0301    0 columns, a combining mark on what is before it
+
+     Widths come from a two level table built once: the top
+     byte of the code point picks a block of 256 two bit
+     widths, and blocks that are the same are only kept once.
+
+     Most lines are plain ASCII, where a byte is a column. The
+     vector kernels (picked like the newline scan, see
+     Scan_Kernel) check that a whole line at a time, so only
+     lines that really hold something else are decoded.
+
+   */
+
+  inline bool is_continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+  }
+
+  // the code point starting s, and how many bytes it took. A
+  // byte that starts nothing valid is taken alone as U+FFFD.
+  size_t decode_utf8(const char* s, size_t n, uint32_t& cp);
+
+  // the same at i of a + b, read in place. A character cut
+  // in two by a gap is put back together first.
+  size_t decode_utf8(std::string_view a, std::string_view b, size_t i, uint32_t& cp);
+
+  int char_width(uint32_t cp); // 0, 1 or 2 columns
+
+  bool is_ascii(std::string_view s);
+  bool is_ascii(Scan_Kernel k, std::string_view s);
+
+  bool valid_utf8(std::string_view s);
+  bool valid_utf8(std::string_view a, std::string_view b); // a + b
+
+  // bytes in the character that starts at / ends just before i.
+  size_t next_char_length(std::string_view s, size_t i);
+  size_t prev_char_length(std::string_view s, size_t i);
+
+
+  /**
+     lay_out
+
+     put the characters of s (or of a + b, the two halves of a
+     gap buffer) on rows cols wide, calling
+     f(offset, row, column, width) for each and once more for
+     where the text ends (width 0). A character that would
+     cross the right edge starts the next row, a combining
+     mark stays with the one before it. f returns false to
+     stop early.
+
+       cols = 5    a b c d 漢 字      row 0: a b c d
+                                     row 1: 漢 字
+   */
+  template<typename F>
+  void lay_out(std::string_view a, std::string_view b, uint32_t cols, F f) {
+
+    const size_t n = a.size() + b.size();
+    uint32_t row = 0;
+    uint32_t col = 0;
+
+    for(size_t i = 0; i < n; ) {
+      uint32_t cp;
+      const size_t len = decode_utf8(a, b, i, cp);
+      const int w = char_width(cp);
+
+      if(col + w > cols && col > 0) {
+        row++;
+        col = 0;
+      }
+
+      if(!f(i, row, col, w))
+        return;
+
+      col += w;
+      i += len;
+    }
+
+    f(n, row, col, 0);
+
+  }
+
+  template<typename F>
+  void lay_out(std::string_view s, uint32_t cols, F f) {
+    lay_out(s, std::string_view(), cols, f);
+  }
+
+}